@@ -1,33 +1,33 @@
+#include <limits.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "rcl57.h"
 #include "state57.h"
-#include "utils57.h"
+#include "ti57.h"
 
 static int digit_to_key_map[] = {82, 72, 73, 74, 62, 63, 64, 52, 53, 54};
 
+/** Resumes the calculator until it waits for a key event. */
+static void run_until_idle(ti57_t *ti57)
+{
+    while (ti57_resume(ti57, INT_MAX) != TI57_YIELD_POLL) {}
+}
+
 static void run(ti57_t *ti57, int *keys, int n)
 {
     // Init.
-    utils57_burst_until_idle(ti57);
+    run_until_idle(ti57);
 
     for (int i = 0; i < n; i++) {
         int key = keys[i] <= 9 ? digit_to_key_map[keys[i]] : keys[i];
 
-        // Key Press.
+        // Key Press: wait for the ROM to ask for the release.
         ti57_key_press(ti57, key / 10, key % 10);
-        utils57_burst_until_busy(ti57);
-        // Key Release.
-        if (ti57->mode != TI57_LRN && key == 81) {  // R/S
-            utils57_burst_until_idle(ti57);  // Waiting for key release
-            ti57_key_release(ti57);
-            utils57_burst_until_busy(ti57);  // Start running
-            utils57_burst_until_idle(ti57);  // Waiting for key press after program run
-        } else {
-            ti57_key_release(ti57);
-            utils57_burst_until_idle(ti57);
-        }
+        run_until_idle(ti57);
+        // Key Release: wait for the next key press, possibly after running a program.
+        ti57_key_release(ti57);
+        run_until_idle(ti57);
     }
 }
 
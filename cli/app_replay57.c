@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "record57.h"
+
+/** Replays the sessions recorded in the files given as arguments. Exits with 1 on any failure. */
+int main(int argc, char **argv)
+{
+    int failed_count = 0;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s RECORDING...\n", argv[0]);
+        return 2;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        FILE *file = fopen(argv[i], "rb");
+        if (file == NULL) {
+            printf("%s: cannot open\n", argv[i]);
+            failed_count++;
+            continue;
+        }
+        long size = fseek(file, 0, SEEK_END) == 0 ? ftell(file) : -1;
+        unsigned char *data = size >= 0 ? malloc(size > 0 ? size : 1) : NULL;
+        if (data == NULL || fseek(file, 0, SEEK_SET) != 0) {
+            printf("%s: cannot read\n", argv[i]);
+            failed_count++;
+            free(data);
+            fclose(file);
+            continue;
+        }
+        size_t read_size = fread(data, 1, size, file);
+        fclose(file);
+
+        rcl57_t rcl57;
+        long event_index;
+        rcl57_init(&rcl57);
+        record57_status_t status = record57_replay(data, read_size, &rcl57, &event_index);
+        free(data);
+
+        switch (status) {
+        case RECORD57_OK:
+            printf("%s: OK, %ld events, %lu cycles\n",
+                   argv[i], event_index, rcl57.ti57.current_cycle);
+            break;
+        case RECORD57_INVALID:
+            printf("%s: invalid recording\n", argv[i]);
+            failed_count++;
+            break;
+        case RECORD57_MISMATCH:
+            printf("%s: mismatch at event %ld, cycle %lu, display [%s]\n",
+                   argv[i], event_index, rcl57.ti57.current_cycle, rcl57_get_display(&rcl57));
+            failed_count++;
+            break;
+        }
+    }
+    return failed_count > 0;
+}
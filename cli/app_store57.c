@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "record57.h"
+#include "save57.h"
+#include "store57.h"
+
+// The saves between syncs.
+#define SYNC_INTERVAL 16
+
+// The most saves before a crash.
+#define MAX_SAVE_COUNT (4 * SYNC_INTERVAL)
+
+// The unit of the writes that reach the disk or not in a crash.
+#define SECTOR_SIZE 512
+
+#define SAVE_MESSAGE 1
+#define SYNC_MESSAGE 2
+
+/** Sent by the writer before each save, and after each sync. */
+typedef struct message_s {
+    int type;
+    int slot;
+    unsigned long cycle;
+    unsigned long checksum;
+} message_t;
+
+/** A state of a slot, as seen by the user. */
+typedef struct state_s {
+    unsigned long cycle;
+    unsigned long checksum;
+} state_t;
+
+/** What the checker knows of a slot. */
+typedef struct slot_s {
+    bool is_synced;
+    state_t synced;                         // The last synced state.
+    int unsynced_count;
+    state_t unsynced[SYNC_INTERVAL];        // The states saved since.
+} slot_t;
+
+static rcl57_t rcl57;
+
+static state_t get_state(rcl57_t *rcl57)
+{
+    state_t state = {rcl57->ti57.current_cycle, record57_get_checksum(rcl57)};
+    return state;
+}
+
+static bool is_same_state(state_t s1, state_t s2)
+{
+    return s1.cycle == s2.cycle && s1.checksum == s2.checksum;
+}
+
+/**
+ * Presses random keys on random slots and saves them, then crashes: only some of the sectors
+ * written since the last sync reach the file, as after a power loss.
+ */
+static int write_slots(const char *path, int fd, unsigned int seed)
+{
+    store57_t store;
+
+    if (!store57_open(&store, path, 0, 0)) return 1;
+    unsigned char *synced = malloc(store.length);
+    if (synced == NULL) return 1;
+
+    // Restoring a slot the first time may clear what remains of a save lost in the last crash,
+    // and sync it.
+    for (int slot = 0; slot < store.slot_count; slot++) {
+        rcl57_init(&rcl57);
+        store57_load(&store, slot, &rcl57);
+    }
+    memcpy(synced, store.base, store.length);
+
+    srand(seed);
+    int save_count = 1 + rand() % MAX_SAVE_COUNT;
+    for (int i = 1; i <= save_count; i++) {
+        int slot = rand() % store.slot_count;
+        rcl57_init(&rcl57);
+        store57_load(&store, slot, &rcl57);
+        rcl57_key_press(&rcl57, 1 + rand() % 8, 1 + rand() % 5);
+        rcl57_advance(&rcl57, 50);
+        rcl57_key_release(&rcl57);
+        rcl57_advance(&rcl57, 50);
+
+        state_t state = get_state(&rcl57);
+        message_t message = {SAVE_MESSAGE, slot, state.cycle, state.checksum};
+        if (write(fd, &message, sizeof(message)) != sizeof(message)) return 1;
+        store57_save(&store, slot, &rcl57, SAVE57_LOG_FLAG);
+
+        if (i % SYNC_INTERVAL == 0) {
+            if (!store57_sync(&store)) return 1;
+            memcpy(synced, store.base, store.length);
+            message.type = SYNC_MESSAGE;
+            if (write(fd, &message, sizeof(message)) != sizeof(message)) return 1;
+        }
+    }
+
+    // Crash: each sector keeps its new content or gets back the one it had at the last sync.
+    for (size_t pos = 0; pos < store.length; pos += SECTOR_SIZE) {
+        size_t size = store.length - pos < SECTOR_SIZE ? store.length - pos : SECTOR_SIZE;
+        if (rand() % 2) memcpy(store.base + pos, synced + pos, size);
+    }
+    return 0;
+}
+
+static void apply_message(slot_t *slots, message_t *message, int slot_count)
+{
+    if (message->type == SAVE_MESSAGE) {
+        slot_t *slot = &slots[message->slot];
+        state_t state = {message->cycle, message->checksum};
+        if (slot->unsynced_count < SYNC_INTERVAL) {
+            slot->unsynced[slot->unsynced_count++] = state;
+        }
+        return;
+    }
+    for (int i = 0; i < slot_count; i++) {
+        if (slots[i].unsynced_count > 0) {
+            slots[i].synced = slots[i].unsynced[slots[i].unsynced_count - 1];
+            slots[i].is_synced = true;
+            slots[i].unsynced_count = 0;
+        }
+    }
+}
+
+/**
+ * Runs a writer until it crashes, and checks that each slot holds its last synced state or a
+ * state saved since. The checker then takes the restored states as the synced ones.
+ */
+static bool run_round(const char *path, slot_t *slots, int slot_count, unsigned int seed)
+{
+    int fds[2];
+    message_t message;
+
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        return false;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return false;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        _exit(write_slots(path, fds[1], seed));
+    }
+    close(fds[1]);
+
+    // The messages of a writer fit in the pipe.
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "the writer failed\n");
+        close(fds[0]);
+        return false;
+    }
+    while (read(fds[0], &message, sizeof(message)) == sizeof(message)) {
+        apply_message(slots, &message, slot_count);
+    }
+    close(fds[0]);
+
+    store57_t store;
+    bool is_ok = true;
+    if (!store57_open(&store, path, 0, 0)) {
+        fprintf(stderr, "can't reopen the store\n");
+        return false;
+    }
+    for (int i = 0; i < slot_count; i++) {
+        slot_t *slot = &slots[i];
+        rcl57_init(&rcl57);
+        bool is_loaded = store57_load(&store, i, &rcl57);
+        state_t state = get_state(&rcl57);
+        bool is_expected = !is_loaded && !slot->is_synced;
+
+        if (is_loaded && slot->is_synced && is_same_state(state, slot->synced)) {
+            is_expected = true;
+        }
+        for (int j = 0; is_loaded && j < slot->unsynced_count; j++) {
+            if (is_same_state(state, slot->unsynced[j])) is_expected = true;
+        }
+        if (!is_expected) {
+            fprintf(stderr, "slot %d: %s\n", i,
+                    is_loaded ? "unexpected state" : "synced state lost");
+            is_ok = false;
+        }
+        slot->is_synced = is_loaded;
+        slot->synced = state;
+        slot->unsynced_count = 0;
+    }
+    store57_close(&store);
+    return is_ok;
+}
+
+static int usage(char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-r ROUNDS] [-k SLOTS] [-s SEED] FILE\n"
+            "Creates a store in FILE, then repeatedly crashes a process saving into it, losing\n"
+            "some of the sectors written since the last sync, and checks that each slot holds its\n"
+            "last synced state or a later one.\n",
+            name);
+    return 2;
+}
+
+int main(int argc, char **argv)
+{
+    int round_count = 100;
+    int slot_count = 16;
+    unsigned int seed = 57;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:k:s:")) != -1) {
+        switch (opt) {
+        case 'r': round_count = atoi(optarg); break;
+        case 'k': slot_count = atoi(optarg); break;
+        case 's': seed = (unsigned int)strtoul(optarg, NULL, 10); break;
+        default: return usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1 || round_count < 0 || slot_count <= 0) return usage(argv[0]);
+    char *path = argv[optind];
+
+    store57_t store;
+    unlink(path);
+    if (!store57_open(&store, path, slot_count, SAVE57_MAX_SIZE)) {
+        fprintf(stderr, "can't create %s\n", path);
+        return 1;
+    }
+    store57_close(&store);
+
+    slot_t *slots = calloc(slot_count, sizeof(slot_t));
+    int failed_count = 0;
+    for (int i = 0; i < round_count; i++) {
+        if (!run_round(path, slots, slot_count, seed + i)) {
+            fprintf(stderr, "round %d failed\n", i);
+            failed_count += 1;
+        }
+    }
+    free(slots);
+    unlink(path);
+    printf("%d rounds, %d failed\n", round_count, failed_count);
+    return failed_count ? 1 : 0;
+}
@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "save57.h"
+#include "sync57.h"
+#include "utils57.h"
+
+// The cycles run after each key press and release.
+#define BURST_CYCLES 5000
+
+/** Writes all of 'buf', returning false on error. */
+static bool write_all(int fd, const unsigned char *buf, int size)
+{
+    while (size > 0) {
+        ssize_t n = write(fd, buf, size);
+        if (n <= 0) return false;
+        buf += n;
+        size -= (int)n;
+    }
+    return true;
+}
+
+/** Reads exactly 'size' bytes, returning false on error or end of file. */
+static bool read_all(int fd, unsigned char *buf, int size)
+{
+    while (size > 0) {
+        ssize_t n = read(fd, buf, size);
+        if (n <= 0) return false;
+        buf += n;
+        size -= (int)n;
+    }
+    return true;
+}
+
+/** Sends a frame: its size on 4 bytes, little endian, then its bytes. */
+static bool send_frame(int fd, const unsigned char *buf, int size)
+{
+    unsigned char header[4];
+
+    for (int i = 0; i < 4; i++) {
+        header[i] = (size >> (8 * i)) & 0xff;
+    }
+    return write_all(fd, header, 4) && write_all(fd, buf, size);
+}
+
+/** Receives a frame into 'buf', returning its size or -1 on error. */
+static int receive_frame(int fd, unsigned char *buf, int max_size)
+{
+    unsigned char header[4];
+    int size = 0;
+
+    if (!read_all(fd, header, 4)) return -1;
+    for (int i = 0; i < 4; i++) {
+        size |= header[i] << (8 * i);
+    }
+    if (size < 0 || size > max_size) return -1;
+    return read_all(fd, buf, size) ? size : -1;
+}
+
+static void boot(ti57_t *ti57)
+{
+    ti57_init(ti57);
+    utils57_burst_until_idle(ti57);
+}
+
+/** Applies the deltas received until an empty frame, then sends back a snapshot of the state. */
+static int receive(int in_fd, int out_fd)
+{
+    static ti57_t ti57;
+    static unsigned char buf[SAVE57_MAX_SIZE];
+
+    boot(&ti57);
+    for (;;) {
+        int size = receive_frame(in_fd, buf, sizeof(buf));
+        if (size < 0) return 1;
+        if (size == 0) break;
+        if (!sync57_patch(&ti57, buf, size)) {
+            fprintf(stderr, "receiver: invalid delta at cycle %lu\n", ti57.current_cycle);
+            return 1;
+        }
+    }
+    int size = save57_write_ti57(&ti57, buf, sizeof(buf), SAVE57_LOG_FLAG);
+    return send_frame(out_fd, buf, size) ? 0 : 1;
+}
+
+/** Runs random keys, sending a delta after each one. Returns whether the receiver is in sync. */
+static bool send(int out_fd, int in_fd, int key_count, unsigned int seed)
+{
+    static ti57_t ti57, base;
+    static unsigned char buf[SAVE57_MAX_SIZE], snapshot[SAVE57_MAX_SIZE];
+    long delta_count = 0, delta_bytes = 0;
+
+    boot(&ti57);
+    base = ti57;
+    srand(seed);
+    for (int i = 0; i < 2 * key_count; i++) {
+        if (i % 2 == 0) {
+            ti57_key_press(&ti57, 1 + rand() % 8, 1 + rand() % 5);
+        } else {
+            ti57_key_release(&ti57);
+        }
+        ti57_resume(&ti57, BURST_CYCLES);
+
+        int size = sync57_diff(&base, &ti57, buf, sizeof(buf));
+        if (size == 0 || !send_frame(out_fd, buf, size)) return false;
+        delta_count += 1;
+        delta_bytes += size;
+    }
+    if (!send_frame(out_fd, buf, 0)) return false;
+
+    int size = receive_frame(in_fd, buf, sizeof(buf));
+    int snapshot_size = save57_write_ti57(&ti57, snapshot, sizeof(snapshot), SAVE57_LOG_FLAG);
+    printf("%ld deltas, %ld bytes on average, snapshot of %d bytes\n",
+           delta_count, delta_count ? delta_bytes / delta_count : 0, snapshot_size);
+    return size == snapshot_size && memcmp(buf, snapshot, size) == 0;
+}
+
+static int usage(char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-n KEYS] [-s SEED]\n"
+            "Presses random keys on a TI-57 and mirrors it into another process through a pipe\n"
+            "with sync57, then checks that both end in the same state.\n", name);
+    return 2;
+}
+
+int main(int argc, char **argv)
+{
+    int key_count = 1000;
+    unsigned int seed = 57;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+        switch (opt) {
+        case 'n': key_count = atoi(optarg); break;
+        case 's': seed = (unsigned int)strtoul(optarg, NULL, 10); break;
+        default: return usage(argv[0]);
+        }
+    }
+    if (optind != argc || key_count < 0) return usage(argv[0]);
+
+    int to_receiver[2], to_sender[2];
+    if (pipe(to_receiver) != 0 || pipe(to_sender) != 0) {
+        perror("pipe");
+        return 1;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return 1;
+    }
+    if (pid == 0) {
+        close(to_receiver[1]);
+        close(to_sender[0]);
+        _exit(receive(to_receiver[0], to_sender[1]));
+    }
+    close(to_receiver[0]);
+    close(to_sender[1]);
+
+    bool is_in_sync = send(to_receiver[1], to_sender[0], key_count, seed);
+    close(to_receiver[1]);
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        is_in_sync = false;
+    }
+    printf("%s\n", is_in_sync ? "OK: the states are identical" : "FAILED: the states differ");
+    return is_in_sync ? 0 : 1;
+}
@@ -0,0 +1,181 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "arena57.h"
+#include "prog57.h"
+#include "tab57.h"
+#include "utils57.h"
+
+// The number of inputs a worker evaluates at a time.
+#define CHUNK_SIZE 64
+
+typedef struct job_s {
+    tab57_t *tab;
+    double from, step;
+    long count;
+    tab57_result_t *results;
+    atomic_long next_chunk;       // The next chunk to evaluate.
+    atomic_bool *is_chunk_done;
+    pthread_mutex_t mutex;        // To wait for the next chunk to print.
+    pthread_cond_t cond;
+} job_t;
+
+typedef struct worker_s {
+    job_t *job;
+    rcl57_t *rcl57;               // The instance to run the evaluations in.
+} worker_t;
+
+static double get_input(job_t *job, long i)
+{
+    return job->from + i * job->step;
+}
+
+/** Evaluates chunks of inputs until there are none left, with its own RCL-57. */
+static void *work(void *arg)
+{
+    worker_t *worker = arg;
+    job_t *job = worker->job;
+    rcl57_t *rcl57 = worker->rcl57;
+    long chunk_count = (job->count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+    for (;;) {
+        long chunk = atomic_fetch_add(&job->next_chunk, 1);
+        if (chunk >= chunk_count) break;
+        long end = (chunk + 1) * CHUNK_SIZE < job->count ? (chunk + 1) * CHUNK_SIZE : job->count;
+        for (long i = chunk * CHUNK_SIZE; i < end; i++) {
+            tab57_eval(job->tab, rcl57, get_input(job, i), &job->results[i]);
+        }
+        pthread_mutex_lock(&job->mutex);
+        atomic_store(&job->is_chunk_done[chunk], true);
+        pthread_cond_broadcast(&job->cond);
+        pthread_mutex_unlock(&job->mutex);
+    }
+    return NULL;
+}
+
+/** Parses "x", "display" or a register "0".."7". Returns -2 if invalid. */
+static int parse_reg(const char *str, int x_value)
+{
+    if (!strcmp(str, "x") || !strcmp(str, "display")) return x_value;
+    if (str[0] >= '0' && str[0] <= '7' && str[1] == 0) return str[0] - '0';
+    return -2;
+}
+
+static int usage(char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-i x|0..7] [-o display|0..7] [-j THREADS] [-c MAX_CYCLES] "
+            "PROGRAM.r57 FROM TO STEP\n"
+            "Runs PROGRAM with RST R/S for each input from FROM to TO, stored into X or a\n"
+            "register, and writes the display or a register as CSV.\n", name);
+    return 2;
+}
+
+int main(int argc, char **argv)
+{
+    int input_reg = TAB57_X, output_reg = TAB57_DISPLAY;
+    int thread_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned long max_cycles = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "i:o:j:c:")) != -1) {
+        switch (opt) {
+        case 'i': input_reg = parse_reg(optarg, TAB57_X); break;
+        case 'o': output_reg = parse_reg(optarg, TAB57_DISPLAY); break;
+        case 'j': thread_count = atoi(optarg); break;
+        case 'c': max_cycles = strtoul(optarg, NULL, 10); break;
+        default: return usage(argv[0]);
+        }
+    }
+    if (argc - optind != 4 || input_reg < -1 || output_reg < -1 || thread_count < 1) {
+        return usage(argv[0]);
+    }
+    double from = atof(argv[optind + 1]), to = atof(argv[optind + 2]);
+    double step = atof(argv[optind + 3]);
+    if (step == 0 || (to - from) / step < 0) {
+        fprintf(stderr, "invalid range\n");
+        return 2;
+    }
+
+    // Read the program.
+    FILE *file = fopen(argv[optind], "rb");
+    if (file == NULL) {
+        fprintf(stderr, "%s: cannot open\n", argv[optind]);
+        return 1;
+    }
+    static char text[20000];
+    text[fread(text, 1, sizeof(text) - 1, file)] = 0;
+    fclose(file);
+    static prog57_t program;
+    if (!prog57_from_text(&program, text)) {
+        fprintf(stderr, "%s: invalid program\n", argv[optind]);
+        return 1;
+    }
+
+    // Boot once, and load the program. Each evaluation starts from there.
+    static rcl57_t rcl57;
+    rcl57_init(&rcl57);
+    utils57_burst_until_idle(&rcl57.ti57);
+    prog57_load_steps_into_memory(&program, &rcl57);
+    prog57_load_registers_into_memory(&program, &rcl57);
+    static tab57_t tab;
+    tab57_init(&tab, &rcl57, input_reg, output_reg, max_cycles);
+
+    job_t job = {0};
+    job.tab = &tab;
+    job.from = from;
+    job.step = step;
+    job.count = (long)((to - from) / step + 1e-9) + 1;
+    long chunk_count = (job.count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    job.results = malloc(job.count * sizeof(tab57_result_t));
+    job.is_chunk_done = calloc(chunk_count, sizeof(atomic_bool));
+    if (job.results == NULL || job.is_chunk_done == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    // The instances are aligned on cache lines, which malloc doesn't guarantee.
+    arena57_t arena;
+    if (!arena57_init(&arena, thread_count)) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    pthread_mutex_init(&job.mutex, NULL);
+    pthread_cond_init(&job.cond, NULL);
+
+    pthread_t threads[thread_count];
+    worker_t workers[thread_count];
+    for (int i = 0; i < thread_count; i++) {
+        workers[i].job = &job;
+        workers[i].rcl57 = arena57_alloc(&arena);
+        pthread_create(&threads[i], NULL, work, &workers[i]);
+    }
+
+    // Print the chunks in order, as soon as they are done.
+    int failed_count = 0;
+    printf("x,result,status,cycles\n");
+    for (long chunk = 0; chunk < chunk_count; chunk++) {
+        pthread_mutex_lock(&job.mutex);
+        while (!atomic_load(&job.is_chunk_done[chunk])) {
+            pthread_cond_wait(&job.cond, &job.mutex);
+        }
+        pthread_mutex_unlock(&job.mutex);
+
+        long end = (chunk + 1) * CHUNK_SIZE < job.count ? (chunk + 1) * CHUNK_SIZE : job.count;
+        for (long i = chunk * CHUNK_SIZE; i < end; i++) {
+            tab57_result_t *result = &job.results[i];
+            printf("%.10g,%s,%s,%lu\n", get_input(&job, i), result->output,
+                   tab57_status_to_str(result->status), result->cycle_count);
+            failed_count += result->status != TAB57_OK;
+        }
+    }
+
+    for (int i = 0; i < thread_count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    arena57_destroy(&arena);
+    return failed_count > 0;
+}
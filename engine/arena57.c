@@ -0,0 +1,45 @@
+#include "arena57.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define CACHE_LINE_SIZE 64
+
+bool arena57_init(arena57_t *arena, int capacity)
+{
+    size_t lines = (sizeof(rcl57_t) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE;
+
+    // An odd number of cache lines.
+    if (lines % 2 == 0) lines++;
+
+    memset(arena, 0, sizeof(arena57_t));
+    arena->stride = lines * CACHE_LINE_SIZE;
+    arena->capacity = capacity > 0 ? capacity : 1;
+    arena->memory = aligned_alloc(CACHE_LINE_SIZE, arena->stride * arena->capacity);
+    return arena->memory != NULL;
+}
+
+void arena57_destroy(arena57_t *arena)
+{
+    free(arena->memory);
+    memset(arena, 0, sizeof(arena57_t));
+}
+
+rcl57_t *arena57_alloc(arena57_t *arena)
+{
+    if (arena->count == arena->capacity) return NULL;
+
+    rcl57_t *rcl57 = arena57_get(arena, arena->count++);
+    rcl57_init(rcl57);
+    return rcl57;
+}
+
+rcl57_t *arena57_get(arena57_t *arena, int index)
+{
+    return (rcl57_t *)(arena->memory + index * arena->stride);
+}
+
+void arena57_reset(arena57_t *arena)
+{
+    arena->count = 0;
+}
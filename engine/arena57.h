@@ -0,0 +1,38 @@
+/**
+ * An arena of RCL-57 instances, for clients that run many of them at once.
+ *
+ * The instances are allocated in one block, aligned on cache lines. They are spaced by an odd
+ * number of cache lines, so that the frequently used fields at the start of the instances don't
+ * all compete for the same cache sets.
+ */
+
+#ifndef arena57_h
+#define arena57_h
+
+#include <stddef.h>
+
+#include "rcl57.h"
+
+typedef struct arena57_s {
+    unsigned char *memory;  // The memory of all the instances.
+    size_t stride;          // The distance between 2 consecutive instances.
+    int capacity;           // The maximum number of instances.
+    int count;              // The number of instances allocated so far.
+} arena57_t;
+
+/** Initializes an arena for up to 'capacity' instances. Returns false if out of memory. */
+bool arena57_init(arena57_t *arena, int capacity);
+
+/** Frees the memory of an arena, including the instances. */
+void arena57_destroy(arena57_t *arena);
+
+/** Returns a new instance, initialized with 'rcl57_init', or NULL if the arena is full. */
+rcl57_t *arena57_alloc(arena57_t *arena);
+
+/** Returns the instance at a given index, in allocation order. */
+rcl57_t *arena57_get(arena57_t *arena, int index);
+
+/** Releases all the instances at once. */
+void arena57_reset(arena57_t *arena);
+
+#endif  /* !arena57_h */
@@ -0,0 +1,82 @@
+#include "fork57.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct fork57_block_s {
+    struct fork57_block_s *next;
+    rcl57_t instances[];
+};
+
+void fork57_copy(rcl57_t *child, const rcl57_t *parent)
+{
+    // The TI-57 state, except for the log, is copied as is.
+    memcpy(&child->ti57, &parent->ti57, offsetof(ti57_t, log));
+    log57_fork(&child->ti57.log, &parent->ti57.log);
+
+    // So are the RCL-57 fields that follow.
+    memcpy(&child->at_end_program, &parent->at_end_program,
+           sizeof(rcl57_t) - offsetof(rcl57_t, at_end_program));
+
+    // The history recorded for the parent doesn't apply to the fork.
+    child->rewind = NULL;
+}
+
+void fork57_detach(rcl57_t *rcl57)
+{
+    log57_detach(&rcl57->ti57.log);
+}
+
+/**
+ * POOL
+ */
+
+void fork57_pool_init(fork57_pool_t *pool, int block_size)
+{
+    pool->block_size = block_size > 0 ? block_size : 1;
+    pool->blocks = NULL;
+    pool->used_count = 0;
+    pool->free_list = NULL;
+}
+
+void fork57_pool_destroy(fork57_pool_t *pool)
+{
+    while (pool->blocks) {
+        struct fork57_block_s *next = pool->blocks->next;
+        free(pool->blocks);
+        pool->blocks = next;
+    }
+    fork57_pool_init(pool, pool->block_size);
+}
+
+rcl57_t *fork57_fork(fork57_pool_t *pool, const rcl57_t *parent)
+{
+    rcl57_t *rcl57;
+
+    if (pool->free_list) {
+        rcl57 = pool->free_list;
+        pool->free_list = *(void **)rcl57;
+    } else {
+        if (pool->blocks == NULL || pool->used_count == pool->block_size) {
+            // Instances are aligned on cache lines.
+            size_t size = sizeof(struct fork57_block_s) + pool->block_size * sizeof(rcl57_t);
+            struct fork57_block_s *block =
+                aligned_alloc(_Alignof(rcl57_t), (size + 63) / 64 * 64);
+            if (block == NULL) return NULL;
+            block->next = pool->blocks;
+            pool->blocks = block;
+            pool->used_count = 0;
+        }
+        rcl57 = &pool->blocks->instances[pool->used_count++];
+    }
+
+    fork57_copy(rcl57, parent);
+    return rcl57;
+}
+
+void fork57_release(fork57_pool_t *pool, rcl57_t *rcl57)
+{
+    *(void **)rcl57 = pool->free_list;
+    pool->free_list = rcl57;
+}
@@ -0,0 +1,43 @@
+/**
+ * Forking a RCL-57, for instance to evaluate what would happen on a given key press without
+ * affecting the original.
+ *
+ * A fork copies the machine state but shares the log entries of its parent until it modifies them.
+ * As a result, a parent should not run, be reset or be released while it has forks, unless they
+ * are detached first.
+ *
+ * Forks can be allocated from a pool, which reuses the memory of the released forks.
+ */
+
+#ifndef fork57_h
+#define fork57_h
+
+#include "rcl57.h"
+
+/** A pool of RCL-57 instances. Not thread-safe. */
+typedef struct fork57_pool_s {
+    int block_size;                 // The number of instances allocated at once.
+    struct fork57_block_s *blocks;  // The blocks of instances allocated so far.
+    int used_count;                 // The number of instances used in the last block.
+    void *free_list;                // The released instances, linked through their first bytes.
+} fork57_pool_t;
+
+/** Copies the state of 'parent' into 'child', sharing the log entries. */
+void fork57_copy(rcl57_t *child, const rcl57_t *parent);
+
+/** Copies the log entries 'rcl57' shares with its parent, so that the parent is no longer needed. */
+void fork57_detach(rcl57_t *rcl57);
+
+/** Initializes a pool that allocates 'block_size' instances at a time. */
+void fork57_pool_init(fork57_pool_t *pool, int block_size);
+
+/** Frees all the memory of a pool, including the instances in use. */
+void fork57_pool_destroy(fork57_pool_t *pool);
+
+/** Returns a fork of 'parent' allocated from 'pool', or NULL if out of memory. */
+rcl57_t *fork57_fork(fork57_pool_t *pool, const rcl57_t *parent);
+
+/** Returns a fork to its pool. */
+void fork57_release(fork57_pool_t *pool, rcl57_t *rcl57);
+
+#endif  /* !fork57_h */
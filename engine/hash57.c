@@ -0,0 +1,207 @@
+#include "hash57.h"
+
+#include <stdlib.h>
+
+// The scalar fields, after the registers.
+#define ROM_FIELD  HASH57_FIELD_COUNT      // The program counter, the stack and the flags.
+#define KEY_FIELD  HASH57_FIELD_COUNT + 1  // The mode, the activity, the key, a pending display.
+
+/** A slot of a table. 'hi' is 0 until the slot is fully written. */
+struct hash57_slot_s {
+    _Atomic uint64_t lo;
+    _Atomic uint64_t hi;
+};
+
+/** The finalizer of SplitMix64, which mixes all the bits of its input. */
+static uint64_t mix(uint64_t x)
+{
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/** Returns the term of the hash for a field of 64 bits. */
+static hash57_t hash_word(int field, uint64_t word)
+{
+    uint64_t x = word + (uint64_t)(field + 1) * 0x9e3779b97f4a7c15ULL;
+    hash57_t hash = {mix(x), mix(x ^ 0x6a09e667f3bcc909ULL)};
+    return hash;
+}
+
+/** Packs the 16 4-bit digits of a register into 64 bits. */
+static uint64_t pack(const ti57_reg_t reg)
+{
+    uint64_t word = 0;
+
+    for (int i = 15; i >= 0; i--) {
+        word = (word << 4) | (reg[i] & 0x0f);
+    }
+    return word;
+}
+
+static void xor_into(hash57_t *hash, hash57_t term)
+{
+    hash->lo ^= term.lo;
+    hash->hi ^= term.hi;
+}
+
+/** Packs a register, with its digits in [start, end) cleared (end - start < 16). */
+static uint64_t pack_without(const ti57_reg_t reg, int start, int end)
+{
+    return pack(reg) & ~(((1ULL << (4 * (end - start))) - 1) << (4 * start));
+}
+
+/**
+ * API IMPLEMENTATION
+ */
+
+hash57_t hash57_reg(hash57_field_t field, const ti57_reg_t reg)
+{
+    return hash_word(field, pack(reg));
+}
+
+hash57_t hash57_state(const ti57_t *ti57, int ignored)
+{
+    hash57_t hash = {0, 0};
+    const ti57_reg_t *regs[] = {&ti57->A, &ti57->B, &ti57->C, &ti57->D};
+
+    for (int i = 0; i < 4; i++) {
+        xor_into(&hash, hash_word(HASH57_A + i, pack(*regs[i])));
+    }
+    for (int i = 0; i < 8; i++) {
+        uint64_t word = pack(ti57->X[i]);
+        if (i == 5 && (ignored & HASH57_IGNORE_PROGRAM_PC)) {
+            word = pack_without(ti57->X[i], 14, 16);
+        }
+        xor_into(&hash, hash_word(HASH57_X0 + i, word));
+    }
+    for (int i = 0; i < 8; i++) {
+        // Steps 0..47 fill Y[0]..Y[5], steps 48 and 49 the high digits of Y[6] and Y[7].
+        uint64_t word = pack(ti57->Y[i]);
+        if (ignored & HASH57_IGNORE_STEPS) {
+            word = i < 6 ? 0 : pack_without(ti57->Y[i], 14, 16);
+        }
+        xor_into(&hash, hash_word(HASH57_Y0 + i, word));
+    }
+    if (!(ignored & HASH57_IGNORE_DISPLAY)) {
+        xor_into(&hash, hash_word(HASH57_DA, pack(ti57->dA)));
+        xor_into(&hash, hash_word(HASH57_DB, pack(ti57->dB)));
+    }
+
+    // 11-bit addresses, then 3 + 8 + 1 + 1 bits.
+    uint64_t rom = (uint64_t)ti57->pc | (uint64_t)ti57->stack[0] << 11 |
+                   (uint64_t)ti57->stack[1] << 22 | (uint64_t)ti57->stack[2] << 33 |
+                   (uint64_t)ti57->RAB << 44 | (uint64_t)ti57->R5 << 47 |
+                   (uint64_t)ti57->COND << 55 | (uint64_t)ti57->is_hex << 56;
+    xor_into(&hash, hash_word(ROM_FIELD, rom));
+    uint64_t key = (uint64_t)ti57->mode | (uint64_t)ti57->activity << 4 |
+                   (uint64_t)ti57->is_key_pressed << 8 | (uint64_t)ti57->is_display_pending << 9 |
+                   (uint64_t)(ti57->row & 0xff) << 16 | (uint64_t)(ti57->col & 0xff) << 24;
+    xor_into(&hash, hash_word(KEY_FIELD, key));
+    return hash;
+}
+
+void hash57_update_reg(hash57_t *hash, hash57_field_t field, const ti57_reg_t old_reg,
+                       const ti57_reg_t new_reg)
+{
+    xor_into(hash, hash57_reg(field, old_reg));
+    xor_into(hash, hash57_reg(field, new_reg));
+}
+
+hash57_t hash57_combine(hash57_t hash, hash57_t other)
+{
+    hash57_t combined = {mix(hash.lo * 0x9e3779b97f4a7c15ULL ^ other.lo),
+                         mix(hash.hi * 0xc2b2ae3d27d4eb4fULL ^ other.hi)};
+    return combined;
+}
+
+bool hash57_equals(hash57_t hash, hash57_t other)
+{
+    return hash.lo == other.lo && hash.hi == other.hi;
+}
+
+/**
+ * TABLE
+ */
+
+bool hash57_table_init(hash57_table_t *table, size_t max_bytes)
+{
+    size_t slot_count = 16;
+
+    while (slot_count * 2 * sizeof(struct hash57_slot_s) <= max_bytes) {
+        slot_count *= 2;
+    }
+    table->slots = calloc(slot_count, sizeof(struct hash57_slot_s));
+    if (table->slots == NULL) return false;
+    table->mask = slot_count - 1;
+    table->max_count = slot_count / 4 * 3;
+    atomic_init(&table->count, 0);
+    return true;
+}
+
+void hash57_table_destroy(hash57_table_t *table)
+{
+    free(table->slots);
+    table->slots = NULL;
+}
+
+/** 0 marks empty slots, so it is replaced in hashes. */
+static hash57_t to_key(hash57_t hash)
+{
+    if (hash.lo == 0) hash.lo = 1;
+    if (hash.hi == 0) hash.hi = 1;
+    return hash;
+}
+
+/** Returns 'hi' of a slot whose 'lo' has been set, waiting for the thread setting it. */
+static uint64_t load_hi(struct hash57_slot_s *slot)
+{
+    uint64_t hi;
+
+    while ((hi = atomic_load_explicit(&slot->hi, memory_order_acquire)) == 0) {
+        // The other thread is between its 2 stores.
+    }
+    return hi;
+}
+
+hash57_insert_t hash57_table_insert(hash57_table_t *table, hash57_t hash)
+{
+    hash57_t key = to_key(hash);
+
+    for (size_t i = key.lo & table->mask;; i = (i + 1) & table->mask) {
+        struct hash57_slot_s *slot = &table->slots[i];
+        uint64_t lo = atomic_load_explicit(&slot->lo, memory_order_acquire);
+        if (lo == 0) {
+            // Reserve a place for the hash first, so that the table never fills up entirely.
+            size_t count = atomic_fetch_add(&table->count, 1);
+            if (count >= table->max_count) {
+                atomic_fetch_sub(&table->count, 1);
+                return HASH57_FULL;
+            }
+            if (atomic_compare_exchange_strong(&slot->lo, &lo, key.lo)) {
+                atomic_store_explicit(&slot->hi, key.hi, memory_order_release);
+                return HASH57_INSERTED;
+            }
+            // Another thread took the slot: 'lo' is now its hash.
+            atomic_fetch_sub(&table->count, 1);
+        }
+        if (lo == key.lo && load_hi(slot) == key.hi) return HASH57_PRESENT;
+    }
+}
+
+bool hash57_table_contains(const hash57_table_t *table, hash57_t hash)
+{
+    hash57_t key = to_key(hash);
+
+    for (size_t i = key.lo & table->mask;; i = (i + 1) & table->mask) {
+        struct hash57_slot_s *slot = &table->slots[i];
+        uint64_t lo = atomic_load_explicit(&slot->lo, memory_order_acquire);
+        if (lo == 0) return false;
+        if (lo == key.lo && load_hi(slot) == key.hi) return true;
+    }
+}
+
+size_t hash57_table_count(const hash57_table_t *table)
+{
+    return atomic_load(&table->count);
+}
@@ -0,0 +1,106 @@
+/**
+ * Canonical hashing of the state of a TI-57, to recognize identical machine states quickly, and a
+ * concurrent table of the states seen so far.
+ *
+ * The hash covers the internal state that determines what the calculator does next: the
+ * registers, the program counter and stack of the ROM, the flags, the mode and the activity, the
+ * key being pressed and the display latch. It ignores the cycle counters, the timestamps, the
+ * decoded steps and the log, so that 2 calculators that went through different histories to the
+ * same state have the same hash.
+ *
+ * The hash is the XOR of one term per field, so that it can be updated incrementally when a
+ * register changes, with 'hash57_update_reg', instead of being computed again.
+ */
+
+#ifndef hash57_h
+#define hash57_h
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ti57.h"
+
+/** A 128-bit hash. The low 64 bits can be used alone as a 64-bit hash. */
+typedef struct hash57_s {
+    uint64_t lo;
+    uint64_t hi;
+} hash57_t;
+
+/** The registers of the state, for 'hash57_reg' and 'hash57_update_reg'. */
+typedef enum hash57_field_e {
+    HASH57_A, HASH57_B, HASH57_C, HASH57_D,
+    HASH57_X0, HASH57_X1, HASH57_X2, HASH57_X3, HASH57_X4, HASH57_X5, HASH57_X6, HASH57_X7,
+    HASH57_Y0, HASH57_Y1, HASH57_Y2, HASH57_Y3, HASH57_Y4, HASH57_Y5, HASH57_Y6, HASH57_Y7,
+    HASH57_DA, HASH57_DB,
+    HASH57_FIELD_COUNT
+} hash57_field_t;
+
+/**
+ * Parts of the state that 'hash57_state' may ignore.
+ */
+#define HASH57_IGNORE_STEPS       0x01  // The steps in 'Y', but not registers 3 and 4.
+#define HASH57_IGNORE_PROGRAM_PC  0x02  // The program counter in 'X[5]', but not register 0.
+#define HASH57_IGNORE_DISPLAY     0x04  // The display latch 'dA' and 'dB'.
+
+/** Returns the hash of the state of 'ti57', ignoring the HASH57_IGNORE_* parts in 'ignored'. */
+hash57_t hash57_state(const ti57_t *ti57, int ignored);
+
+/** Returns the term of the hash for a register. */
+hash57_t hash57_reg(hash57_field_t field, const ti57_reg_t reg);
+
+/**
+ * Updates 'hash' for a register that changed from 'old_reg' to 'new_reg', as if it had been
+ * computed again. The register should not be in a part ignored by 'hash'.
+ */
+void hash57_update_reg(hash57_t *hash, hash57_field_t field, const ti57_reg_t old_reg,
+                       const ti57_reg_t new_reg);
+
+/** Combines 2 hashes, in order, such as the hashes of the states of several runs. */
+hash57_t hash57_combine(hash57_t hash, hash57_t other);
+
+/** Returns whether 2 hashes are equal. */
+bool hash57_equals(hash57_t hash, hash57_t other);
+
+/**
+ * TABLE
+ */
+
+/** The status of 'hash57_table_insert'. */
+typedef enum hash57_insert_e {
+    HASH57_INSERTED,  // The hash was not in the table, and has been inserted.
+    HASH57_PRESENT,   // The hash was already in the table.
+    HASH57_FULL,      // The hash was not in the table, and the table is full.
+} hash57_insert_t;
+
+/**
+ * A set of hashes that may be used from several threads at once, without locks.
+ *
+ * The table has a fixed size, set from a memory cap. Hashes can't be removed, and inserting fails
+ * once the table is 3/4 full, so that lookups stay short: a client that prunes the states it has
+ * seen before should then just stop pruning the new ones.
+ */
+typedef struct hash57_table_s {
+    struct hash57_slot_s *slots;
+    size_t mask;             // The number of slots - 1, a power of 2.
+    size_t max_count;        // The number of hashes when the table is full.
+    atomic_size_t count;
+} hash57_table_t;
+
+/** Initializes a table that uses at most 'max_bytes' of memory. Returns false if out of memory. */
+bool hash57_table_init(hash57_table_t *table, size_t max_bytes);
+
+/** Frees the memory of a table. */
+void hash57_table_destroy(hash57_table_t *table);
+
+/** Inserts a hash. */
+hash57_insert_t hash57_table_insert(hash57_table_t *table, hash57_t hash);
+
+/** Returns whether a hash has been inserted. */
+bool hash57_table_contains(const hash57_table_t *table, hash57_t hash);
+
+/** Returns the number of hashes inserted. */
+size_t hash57_table_count(const hash57_table_t *table);
+
+#endif  /* !hash57_h */
@@ -105,6 +105,19 @@ key57_t key57_get_key(int row, int col, bool is_secondary)
     }
 }
 
+bool key57_is_valid(key57_t key)
+{
+    if (key < 0x10) return key <= 0x09;
+
+    // The secondary keys of the 5th column have 0 in their low digit.
+    return (key >> 4) <= 8 && (key & 0x0f) <= 9;
+}
+
+bool key57_is_valid_row_col(int row, int col)
+{
+    return (row == 0 && col == 0) || (1 <= row && row <= 8 && 1 <= col && col <= 5);
+}
+
 char *key57_get_ascii_name(key57_t key)
 {
     return get_name(key, false);
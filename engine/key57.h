@@ -27,6 +27,12 @@ typedef unsigned char key57_t;
 /** Returns the primary or secondary key at a given row (1..8) and column (1..5). */
 key57_t key57_get_key(int row, int col, bool is_secondary);
 
+/** Returns whether 'key' is a digit or a primary or secondary key, as from 'key57_get_key'. */
+bool key57_is_valid(key57_t key);
+
+/** Returns whether a row and a column are 0 (no key pressed yet) or 1..8 and 1..5. */
+bool key57_is_valid_row_col(int row, int col);
+
 /**
  * Returns the ASCII name of a given key.
  *
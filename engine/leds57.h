@@ -12,4 +12,17 @@
  */
 int leds57_get_segments(unsigned char c);
 
+/** Bit set, in addition to the segments, for a LED followed by a decimal point. */
+#define LEDS57_DOT 0x4000
+
+/**
+ * Converts a display string, such as "  -3.14159   ", into the segments of its LEDs.
+ *
+ * Fills 'leds' with the segments of the first 'n' LEDs, from left to right, with the LEDS57_DOT bit
+ * set for a LED followed by a decimal point. LEDs past the end of the string are blank.
+ *
+ * Returns the number of LEDs in the string, at most 'n'.
+ */
+int leds57_get_display_segments(const char *display, unsigned short *leds, int n);
+
 #endif /* leds57_h */
@@ -1,18 +1,35 @@
 #include "log57.h"
 
 #include <assert.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 
-// Returns the entry at a given index.
-static log57_entry_t *get_entry(log57_t *log, long index)
+// Returns the entry at a given index, possibly from the parent log.
+static const log57_entry_t *get_entry(const log57_t *log, long index)
 {
     assert(index >= 1 && index >= log->logged_count - LOG57_MAX_ENTRY_COUNT + 1);
     assert(index <= log->logged_count);
 
+    if (index <= log->parent_count) {
+        return get_entry(log->parent, index);
+    }
     return &log->entries[index % LOG57_MAX_ENTRY_COUNT];
 }
 
+// Returns the entry at a given index for modification, copying it from the parent log if needed.
+// Only the last entry can be modified.
+static log57_entry_t *get_entry_for_writing(log57_t *log, long index)
+{
+    log57_entry_t *entry = &log->entries[index % LOG57_MAX_ENTRY_COUNT];
+
+    if (index <= log->parent_count) {
+        *entry = *get_entry(log, index);
+        log->parent_count = index - 1;
+    }
+    return entry;
+}
+
 static log57_entry_t LOG57_BLANK_ENTRY_2 = {"", LOG57_NUMBER_IN, 0};
 
 log57_entry_t *LOG57_BLANK_ENTRY = &LOG57_BLANK_ENTRY_2;
@@ -22,27 +39,44 @@ void log57_reset(log57_t *log)
     memset(log, 0, sizeof(log57_t));
 }
 
+void log57_fork(log57_t *log, const log57_t *parent)
+{
+    // Copy everything but the entries.
+    memcpy(&log->logged_count, &parent->logged_count,
+           sizeof(log57_t) - offsetof(log57_t, logged_count));
+    log->parent = parent;
+    log->parent_count = parent->logged_count;
+}
+
+void log57_detach(log57_t *log)
+{
+    if (log->parent == NULL) return;
+
+    long first = log->logged_count - LOG57_MAX_ENTRY_COUNT + 1;
+    for (long i = first < 1 ? 1 : first; i <= log->parent_count; i++) {
+        log->entries[i % LOG57_MAX_ENTRY_COUNT] = *get_entry(log->parent, i);
+    }
+    log->parent = NULL;
+    log->parent_count = 0;
+}
+
 /**
  * ACTUAL LOGGING
  */
 
 void log57_log_op(log57_t *log, op57_t *op, bool is_pending)
 {
-    log57_entry_t *entry = NULL;
-
     log->timestamp += 1;
 
     // Decide whether to override the last entry.
     if (log->logged_count > 0) {
-        entry = get_entry(log, log->logged_count);
-        if (entry->type != LOG57_PENDING_OP) {
+        if (get_entry(log, log->logged_count)->type != LOG57_PENDING_OP) {
             log->logged_count += 1;
-            entry = get_entry(log, log->logged_count);
         }
     } else {
         log->logged_count = 1;
-        entry = get_entry(log, 1);
     }
+    log57_entry_t *entry = get_entry_for_writing(log, log->logged_count);
 
     // Compute optional parameter.
     char param[3];
@@ -79,7 +113,7 @@ void log57_log_display(log57_t *log, char *display, log57_type_t type, bool is_e
     }
 
     // Set entry.
-    log57_entry_t *entry = get_entry(log, log->logged_count);
+    log57_entry_t *entry = get_entry_for_writing(log, log->logged_count);
     strcpy(entry->message, display);
     entry->type = type;
     entry->flags = is_error ? LOG57_ERROR_FLAG : 0;
@@ -96,7 +130,7 @@ long log57_get_logged_count(log57_t *log)
 
 log57_entry_t *log57_get_entry(log57_t *log, long index)
 {
-    return get_entry(log, index);
+    return (log57_entry_t *)get_entry(log, index);
 }
 
 /**
@@ -48,6 +48,11 @@ typedef struct log57_s {
     // The timestamp is incremented whenever there is a change to the log. It can be used by clients
     // to update the UI only when needed.
     long timestamp;
+
+    // After a fork, the entries up to 'parent_count' are read from the parent log, until they are
+    // modified.
+    const struct log57_s *parent;
+    long parent_count;
 } log57_t;
 
 extern log57_entry_t *LOG57_BLANK_ENTRY;
@@ -55,6 +60,16 @@ extern log57_entry_t *LOG57_BLANK_ENTRY;
 /** Resets the log, setting the logged_count to 0. */
 void log57_reset(log57_t *log);
 
+/**
+ * Initializes 'log' as a copy of 'parent' that shares its entries instead of copying them.
+ *
+ * 'parent' should not be modified or reset while 'log' is in use, unless 'log' is detached first.
+ */
+void log57_fork(log57_t *log, const log57_t *parent);
+
+/** Copies the entries shared with the parent log, if any, so that the parent is no longer needed. */
+void log57_detach(log57_t *log);
+
 /**
  * ACTUAL LOGGING
  */
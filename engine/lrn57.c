@@ -223,7 +223,7 @@ void lrn57_key_press_in_hp_mode(rcl57_t *rcl57, int row, int col)
 
 char *lrn57_get_display(rcl57_t *rcl57)
 {
-    static char str[25];
+    static _Thread_local char str[25];
     ti57_t *ti57 = &rcl57->ti57;
     int pc = ti57_get_program_pc(ti57);
     bool op_pending = ti57_is_op_edit_in_lrn(ti57);
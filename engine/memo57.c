@@ -0,0 +1,213 @@
+#include "memo57.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rom57.h"
+
+/** An entry of the cache. 'cycle_count' is 0 for empty entries. */
+struct memo57_entry_s {
+    memo57_regs_t in;
+    memo57_regs_t out;
+    unsigned long cycle_count;
+};
+
+/**
+ * ANALYSIS
+ */
+
+/**
+ * Follows the code from 'address' until it returns. Returns false if it reaches an operation that
+ * isn't pure, or calls a subroutine that isn't in 'is_pure'.
+ */
+static bool check_code(ti57_address_t address, const bool *is_pure)
+{
+    bool visited[2048] = {false};
+    ti57_address_t pending[2048];
+    int pending_count = 0;
+
+    pending[pending_count++] = address;
+    visited[address] = true;
+    while (pending_count) {
+        ti57_address_t pc = pending[--pending_count];
+        unsigned short opcode = ROM57[pc];
+        ti57_address_t next[2];
+        int next_count = 0;
+
+        if (!memo57_is_pure_op(opcode)) return false;
+        if ((opcode & 0x1800) == 0x1800) {
+            // Branch, within the same half of the ROM.
+            next[next_count++] = pc + 1;
+            next[next_count++] = ((pc + 1) & 0x400) | (opcode & 0x3ff);
+        } else if ((opcode & 0x1800) == 0x1000) {
+            // Call, which returns to the next address.
+            if (!is_pure[opcode & 0x7ff]) return false;
+            next[next_count++] = pc + 1;
+        } else if ((opcode & 0x1f0f) == 0x0e03) {
+            // Return.
+            continue;
+        } else {
+            next[next_count++] = pc + 1;
+        }
+        for (int i = 0; i < next_count; i++) {
+            if (next[i] >= 2048) return false;
+            if (!visited[next[i]]) {
+                visited[next[i]] = true;
+                pending[pending_count++] = next[i];
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * Finds the subroutines that are pure. Starting from all the subroutines called somewhere, those
+ * that aren't pure are removed until the remaining ones only call each other.
+ */
+static void find_pure_routines(bool *is_pure)
+{
+    for (int pc = 0; pc < 2048; pc++) {
+        is_pure[pc] = false;
+    }
+    for (int pc = 0; pc < 2048; pc++) {
+        if ((ROM57[pc] & 0x1800) == 0x1000) {
+            is_pure[ROM57[pc] & 0x7ff] = true;
+        }
+    }
+    for (bool is_changed = true; is_changed;) {
+        is_changed = false;
+        for (int pc = 0; pc < 2048; pc++) {
+            if (is_pure[pc] && !check_code(pc, is_pure)) {
+                is_pure[pc] = false;
+                is_changed = true;
+            }
+        }
+    }
+}
+
+/**
+ * CACHE
+ */
+
+/** The finalizer of SplitMix64, as in hash57.c. */
+static uint64_t mix(uint64_t x)
+{
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static size_t hash_regs(const memo57_regs_t *regs)
+{
+    const unsigned char *bytes = (const unsigned char *)regs;
+    uint64_t hash = 0;
+
+    for (size_t i = 0; i < sizeof(memo57_regs_t); i += 8) {
+        uint64_t word = 0;
+        size_t n = sizeof(memo57_regs_t) - i < 8 ? sizeof(memo57_regs_t) - i : 8;
+        memcpy(&word, bytes + i, n);
+        hash = mix(hash ^ word);
+    }
+    return (size_t)hash;
+}
+
+static void reset_counts(memo57_t *memo)
+{
+    memcpy(memo->is_enabled, memo->is_pure, sizeof(memo->is_enabled));
+    memset(memo->lookup_counts, 0, sizeof(memo->lookup_counts));
+    memset(memo->hit_counts, 0, sizeof(memo->hit_counts));
+    memo->hit_count = memo->miss_count = memo->mismatch_count = 0;
+}
+
+/**
+ * API IMPLEMENTATION
+ */
+
+bool memo57_init(memo57_t *memo, size_t max_bytes)
+{
+    size_t entry_count = 16;
+
+    if (max_bytes == 0) max_bytes = MEMO57_DEFAULT_BYTES;
+    while (entry_count * 2 * sizeof(struct memo57_entry_s) <= max_bytes) {
+        entry_count *= 2;
+    }
+    memo->entries = calloc(entry_count, sizeof(struct memo57_entry_s));
+    if (memo->entries == NULL) return false;
+    memo->mask = entry_count - 1;
+    memo->is_verifying = false;
+    find_pure_routines(memo->is_pure);
+    reset_counts(memo);
+    return true;
+}
+
+void memo57_destroy(memo57_t *memo)
+{
+    free(memo->entries);
+    memo->entries = NULL;
+}
+
+void memo57_clear(memo57_t *memo)
+{
+    memset(memo->entries, 0, (memo->mask + 1) * sizeof(struct memo57_entry_s));
+    reset_counts(memo);
+}
+
+int memo57_get_pure_routines(const memo57_t *memo, ti57_address_t *addresses)
+{
+    int count = 0;
+
+    for (int pc = 0; pc < 2048; pc++) {
+        if (memo->is_pure[pc]) {
+            if (addresses) addresses[count] = pc;
+            count++;
+        }
+    }
+    return count;
+}
+
+bool memo57_is_pure_op(unsigned short opcode)
+{
+    if ((opcode & 0x1f00) != 0x0e00) return true;
+
+    // Misc operations that access X, Y, the display or the keyboard, or jump to R5.
+    switch (opcode & 0x000f) {
+    case 0: case 2: case 4: case 5: case 6: case 7:
+        return false;
+    default:
+        return true;
+    }
+}
+
+const memo57_regs_t *memo57_find(memo57_t *memo, const memo57_regs_t *in,
+                                 unsigned long *cycle_count)
+{
+    struct memo57_entry_s *entry = &memo->entries[hash_regs(in) & memo->mask];
+    unsigned int lookup_count = ++memo->lookup_counts[in->pc];
+
+    if (entry->cycle_count == 0 || memcmp(&entry->in, in, sizeof(memo57_regs_t)) != 0) {
+        memo->miss_count += 1;
+        if (lookup_count >= MEMO57_MIN_LOOKUPS && memo->hit_counts[in->pc] < lookup_count / 2) {
+            memo->is_enabled[in->pc] = false;
+        }
+        return NULL;
+    }
+    memo->hit_count += 1;
+    memo->hit_counts[in->pc] += 1;
+    *cycle_count = entry->cycle_count;
+    return &entry->out;
+}
+
+void memo57_add(memo57_t *memo, const memo57_regs_t *in, const memo57_regs_t *out,
+                unsigned long cycle_count)
+{
+    if (cycle_count < MEMO57_MIN_CYCLES) {
+        memo->is_enabled[in->pc] = false;
+        return;
+    }
+
+    struct memo57_entry_s *entry = &memo->entries[hash_regs(in) & memo->mask];
+    entry->in = *in;
+    entry->out = *out;
+    entry->cycle_count = cycle_count;
+}
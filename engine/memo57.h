@@ -0,0 +1,105 @@
+/**
+ * Memoization of the pure subroutines of the ROM, such as the arithmetic ones, for clients that
+ * evaluate the same operations on the same operands over and over, like searches and batches.
+ *
+ * A subroutine of the ROM is pure if it only uses the operational registers A..D, R5, RAB, the
+ * flags and the stack: it doesn't read or write the storage registers X and Y, the display or the
+ * keyboard, nor does it jump to an address computed at runtime. The pure subroutines are found
+ * once, by following the code of the ROM from each address that is called.
+ *
+ * When a calculator with a cache calls a pure subroutine, the cache is looked up with everything
+ * the subroutine may read. On a hit, the registers, the program counter, the stack, the flags and
+ * the cycle counter are set as they were when the subroutine returned the first time, without
+ * running it. On a miss, the subroutine is run until it returns and its outputs are added.
+ *
+ * Only the runs that keep the same mode and activity throughout are cached, so that nothing the
+ * client may observe is skipped: the result is the same, cycle for cycle, as without the cache,
+ * except that the timestamps of the state advance at most once for a cached subroutine.
+ *
+ * Most calls to the pure subroutines return within a few cycles, or come from loops whose operands
+ * never repeat, so a subroutine is no longer looked up once it proves not to be worth it: when it
+ * returns within MEMO57_MIN_CYCLES, or when most of its lookups miss.
+ *
+ * A cache is not thread-safe: each thread should have its own. It is attached to a calculator by
+ * setting 'memo' in 'ti57_t', which 'fork57_copy' copies along with the rest of the state.
+ */
+
+#ifndef memo57_h
+#define memo57_h
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "state57.h"
+
+/** The default of 'max_bytes' in 'memo57_init'. */
+#define MEMO57_DEFAULT_BYTES (1 << 20)
+
+/** The fewest cycles a subroutine should take to be cached, more than a lookup costs. */
+#define MEMO57_MIN_CYCLES 32
+
+/** The number of lookups of a subroutine after which it is no longer looked up if most missed. */
+#define MEMO57_MIN_LOOKUPS 64
+
+/** The part of the state a pure subroutine reads and writes. */
+typedef struct memo57_regs_s {
+    ti57_reg_t A, B, C, D;
+    ti57_address_t pc;
+    ti57_address_t stack[3];
+    unsigned char RAB;
+    unsigned char R5;
+    bool COND;
+    bool is_hex;
+} memo57_regs_t;
+
+typedef struct memo57_s {
+    struct memo57_entry_s *entries;
+    size_t mask;                   // The number of entries - 1, a power of 2.
+    bool is_pure[2048];            // Whether the subroutine at each address is pure.
+    bool is_enabled[2048];         // Whether the subroutine at each address is still looked up.
+    unsigned int lookup_counts[2048];
+    unsigned int hit_counts[2048];
+    bool is_verifying;             // Whether to run the subroutines on hits too, to compare.
+    long hit_count;
+    long miss_count;
+    long mismatch_count;           // The hits whose outputs differ from those of an actual run.
+} memo57_t;
+
+/**
+ * Initializes a cache that uses at most 'max_bytes' of memory, or MEMO57_DEFAULT_BYTES if 0.
+ *
+ * Returns false if out of memory.
+ */
+bool memo57_init(memo57_t *memo, size_t max_bytes);
+
+/** Frees the memory of a cache. */
+void memo57_destroy(memo57_t *memo);
+
+/** Removes all the entries, resets the counts and looks up all the pure subroutines again. */
+void memo57_clear(memo57_t *memo);
+
+/**
+ * Returns the number of pure subroutines, and stores their addresses into 'addresses' if not
+ * NULL, in increasing order.
+ */
+int memo57_get_pure_routines(const memo57_t *memo, ti57_address_t *addresses);
+
+/** Returns whether an opcode can be part of a pure subroutine. */
+bool memo57_is_pure_op(unsigned short opcode);
+
+/**
+ * Returns the outputs of the subroutine called with inputs 'in', where 'pc' is the address of the
+ * subroutine, or NULL if not in the cache. On a hit, the cycles the subroutine takes are stored
+ * into 'cycle_count'.
+ */
+const memo57_regs_t *memo57_find(memo57_t *memo, const memo57_regs_t *in,
+                                 unsigned long *cycle_count);
+
+/**
+ * Adds the outputs of the subroutine called with inputs 'in', replacing an older entry if needed,
+ * unless the subroutine is too short to be worth caching.
+ */
+void memo57_add(memo57_t *memo, const memo57_regs_t *in, const memo57_regs_t *out,
+                unsigned long cycle_count);
+
+#endif  /* !memo57_h */
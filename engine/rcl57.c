@@ -1,23 +1,39 @@
 #include <assert.h>
+#include <limits.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
+#include "leds57.h"
 #include "lrn57.h"
 #include "rcl57.h"
+#include "rewind57.h"
 #include "utils57.h"
 
+#define POST_WINDOW_CYCLES 500
+
 static bool is_post_pause(ti57_t *ti57) {
     long diff = ti57->current_cycle - ti57->last_pause_cycle;
-    return diff > 0 && diff <= 500;
+    return diff > 0 && diff <= POST_WINDOW_CYCLES;
 }
 
 static bool is_post_eval(ti57_t *ti57) {
     long diff = ti57->current_cycle - ti57->last_eval_cycle;
-    return diff > 0 && diff <= 500;
+    return diff > 0 && diff <= POST_WINDOW_CYCLES;
+}
+
+/** Returns the first cycle at which 'is_post_pause' or 'is_post_eval' may change for 'cycle'. */
+static unsigned long get_post_window_change(ti57_t *ti57, unsigned long cycle)
+{
+    long diff = ti57->current_cycle - cycle;
+
+    if (diff <= 0) return cycle + 1;
+    if (diff <= POST_WINDOW_CYCLES) return cycle + POST_WINDOW_CYCLES + 1;
+    return ULONG_MAX;
 }
 
 // -1 means as fast as possible.
-static double get_goal_speed(rcl57_t *rcl57)
+static int get_goal_speed(rcl57_t *rcl57)
 {
     ti57_t *ti57 = &rcl57->ti57;
 
@@ -59,10 +75,197 @@ static double get_goal_speed(rcl57_t *rcl57)
     }
 }
 
+/** How the instructions are charged to the budget of 'rcl57_advance'. */
+typedef enum pace_e {
+    PACE_FULL,    // As fast as possible: n cycles cost n.
+    PACE_SCALED,  // Speed 1: n cycles cost n * speedup.
+    PACE_HALF,    // Speed 2: n cycles cost n * speedup / 2, rounded up.
+} pace_t;
+
+/**
+ * The pace of 'rcl57_advance', valid as long as the mode and the activity do not change and the
+ * current cycle is below 'until_cycle'. The keys and the options do not change while advancing.
+ *
+ * The costs are those of the budget when it was a truncated double.
+ */
+typedef struct governor_s {
+    ti57_mode_t mode;
+    ti57_activity_t activity;
+    unsigned long until_cycle;
+    pace_t pace;
+    unsigned int factor;
+    bool is_quick_stopping;
+} governor_t;
+
+static void update_governor(rcl57_t *rcl57, governor_t *governor)
+{
+    ti57_t *ti57 = &rcl57->ti57;
+    unsigned long pause_change = get_post_window_change(ti57, ti57->last_pause_cycle);
+    unsigned long eval_change = get_post_window_change(ti57, ti57->last_eval_cycle);
+    int speed = get_goal_speed(rcl57);
+
+    governor->mode = ti57->mode;
+    governor->activity = ti57->activity;
+    governor->pace = speed < 0 ? PACE_FULL : speed == 2 ? PACE_HALF : PACE_SCALED;
+    governor->factor = rcl57->speedup;
+    governor->is_quick_stopping = ti57_is_stopping(ti57) &&
+                                  rcl57->options & RCL57_QUICK_STOP_FLAG;
+
+    // While stopping, every instruction goes through 'govern'.
+    if (governor->is_quick_stopping) {
+        governor->until_cycle = 0;
+        return;
+    }
+    governor->until_cycle = pause_change < eval_change ? pause_change : eval_change;
+    if (rcl57->rewind && rcl57->rewind->next_cycle < governor->until_cycle) {
+        governor->until_cycle = rcl57->rewind->next_cycle;
+    }
+}
+
+/** Returns the cost of 'n' cycles. Inlined with a constant 'pace' in the loops below. */
+static inline int get_cost(pace_t pace, unsigned int factor, int n)
+{
+    switch (pace) {
+    case PACE_FULL:
+        return n;
+    case PACE_SCALED:
+        return (int)(n * factor);
+    case PACE_HALF:
+        return (int)((n * factor + 1) >> 1);
+    }
+    return n;
+}
+
+/** Handles the instruction just executed when the governor is no longer valid. */
+static void govern(rcl57_t *rcl57, governor_t *governor)
+{
+    ti57_t *ti57 = &rcl57->ti57;
+
+    update_governor(rcl57, governor);
+    if (governor->is_quick_stopping) {
+        utils57_burst_until_idle(ti57);
+        update_governor(rcl57, governor);
+    }
+    if (rcl57->rewind && ti57->current_cycle >= rcl57->rewind->next_cycle) {
+        rewind57_checkpoint(rcl57->rewind, rcl57);
+        update_governor(rcl57, governor);
+    }
+}
+
+/**
+ * Executes instructions at 'pace' until the budget runs out (returning from
+ * 'advance_cycles') or the governor is no longer valid (leaving 'n' for the last instruction).
+ *
+ * There is one instance per pace, so that the loop does not test the pace.
+ */
+#define ADVANCE_WHILE_GOVERNED(pace)                                                  \
+    for (;;) {                                                                        \
+        n = ti57_next(ti57);                                                          \
+        if (ti57->mode != governor.mode || ti57->activity != governor.activity ||     \
+            ti57->current_cycle >= governor.until_cycle) {                            \
+            break;                                                                    \
+        }                                                                             \
+        max_cycles -= get_cost(pace, governor.factor, n);                             \
+        if (max_cycles <= 0) return max_cycles;                                       \
+    }
+
 void rcl57_init(rcl57_t *rcl57)
 {
     memset(rcl57, 0, sizeof(rcl57_t));
     rcl57->speedup = 1;
+    rcl57->pacing.max_catch_up_ms = RCL57_DEFAULT_MAX_CATCH_UP_MS;
+    rcl57->turbo.cpu_percent = RCL57_DEFAULT_TURBO_CPU_PERCENT;
+}
+
+/**
+ * Executes instructions until 'max_cycles' of budget have been spent.
+ *
+ * Returns the budget left, 0 or less since the last instruction may exceed it.
+ */
+static int advance_cycles(rcl57_t *rcl57, int max_cycles)
+{
+    ti57_t *ti57 = &rcl57->ti57;
+    governor_t governor;
+
+    // Nobody looks at the display registers while the run indicator is shown.
+    ti57->is_lazy_display = (rcl57->options & RCL57_SHOW_RUN_INDICATOR_FLAG) != 0;
+
+    update_governor(rcl57, &governor);
+    for (;;) {
+        int n = 0;
+        switch (governor.pace) {
+        case PACE_FULL:
+            ADVANCE_WHILE_GOVERNED(PACE_FULL);
+            break;
+        case PACE_SCALED:
+            ADVANCE_WHILE_GOVERNED(PACE_SCALED);
+            break;
+        case PACE_HALF:
+            ADVANCE_WHILE_GOVERNED(PACE_HALF);
+            break;
+        }
+        govern(rcl57, &governor);
+        max_cycles -= get_cost(governor.pace, governor.factor, n);
+        if (max_cycles <= 0) return max_cycles;
+    }
+}
+
+// The highest speedup in turbo mode, so that the budgets in cycles fit in an int.
+#define MAX_TURBO_SPEEDUP 100000
+
+static long long get_host_time_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/** Sets the speedup in turbo mode, given that the host emulated 'cycles' in 'elapsed_ns'. */
+static void update_turbo(rcl57_t *rcl57, unsigned long cycles, long long elapsed_ns)
+{
+    rcl57_turbo_t *turbo = &rcl57->turbo;
+
+    if (cycles == 0 || elapsed_ns <= 0) return;
+
+    // Slow down quickly, for instance when the host gets busy, and speed up slowly.
+    long cycles_per_ms = (long)(cycles * 1000000 / elapsed_ns);
+    if (turbo->cycles_per_ms == 0) {
+        turbo->cycles_per_ms = cycles_per_ms;
+    } else if (cycles_per_ms < turbo->cycles_per_ms) {
+        turbo->cycles_per_ms = (turbo->cycles_per_ms + cycles_per_ms) / 2;
+    } else {
+        turbo->cycles_per_ms += (cycles_per_ms - turbo->cycles_per_ms) / 8;
+    }
+
+    // At full speed, 5 * speedup cycles are run per ms.
+    long speedup = turbo->cycles_per_ms * turbo->cpu_percent / 100 / 5;
+    if (speedup < 1) {
+        speedup = 1;
+    } else if (speedup > MAX_TURBO_SPEEDUP) {
+        speedup = MAX_TURBO_SPEEDUP;
+    }
+    rcl57->speedup = (unsigned int)speedup;
+}
+
+/** Same as 'advance_cycles', measuring the speed of the host in turbo mode. */
+static int advance_cycles_and_measure(rcl57_t *rcl57, int max_cycles)
+{
+    ti57_t *ti57 = &rcl57->ti57;
+
+    if (!(rcl57->options & RCL57_TURBO_FLAG)) {
+        return advance_cycles(rcl57, max_cycles);
+    }
+
+    // Instructions are faster to emulate while polling the keyboard: only measure busy periods.
+    bool is_busy = ti57->activity == TI57_BUSY;
+    unsigned long start_cycle = ti57->current_cycle;
+    long long start_ns = get_host_time_ns();
+    int left = advance_cycles(rcl57, max_cycles);
+    if (is_busy) {
+        update_turbo(rcl57, ti57->current_cycle - start_cycle, get_host_time_ns() - start_ns);
+    }
+    return left;
 }
 
 bool rcl57_advance(rcl57_t *rcl57, int ms)
@@ -70,38 +273,149 @@ bool rcl57_advance(rcl57_t *rcl57, int ms)
     assert(ms > 0);
     assert(rcl57->speedup > 0);
 
-    ti57_t *ti57 = &rcl57->ti57;
-
     // An actual TI-57 executes 5000 cycles per second (speed 1).
-    int max_cycles = 5 * ms * rcl57->speedup;
+    advance_cycles_and_measure(rcl57, 5 * ms * rcl57->speedup);
 
-    do {
-        int n = ti57_next(ti57);
-        if (ti57_is_stopping(ti57) &&
-            rcl57->options & RCL57_QUICK_STOP_FLAG) {
-            utils57_burst_until_idle(ti57);
-        }
-        double current_speed = get_goal_speed(rcl57);
-        if (current_speed == 0) {
-            utils57_burst_until_idle(ti57);
-            return false;
+    return rcl57_get_wakeup_ms(rcl57) != RCL57_WAKEUP_NEVER;
+}
+
+// The duration of a cycle of an actual TI-57, in ns.
+#define NS_PER_CYCLE 200000
+
+bool rcl57_advance_to(rcl57_t *rcl57, long long host_time_ns)
+{
+    assert(rcl57->speedup > 0);
+
+    rcl57_pacing_t *pacing = &rcl57->pacing;
+    long long elapsed_ns = host_time_ns - pacing->last_time_ns;
+    long long max_ns = (long long)pacing->max_catch_up_ms * 1000000;
+
+    if (!pacing->is_started) {
+        pacing->is_started = true;
+        elapsed_ns = 0;
+    }
+    pacing->last_time_ns = host_time_ns;
+    if (elapsed_ns > 0) {
+        pacing->paced_ns += elapsed_ns;
+        if (elapsed_ns > max_ns) {
+            pacing->dropped_ns += elapsed_ns - max_ns;
+            elapsed_ns = max_ns;
         }
-        if (current_speed < 0) {
-            max_cycles -= n;
-        } else if (current_speed == 0) {
-            max_cycles = 0;
-        } else {
-            max_cycles -= n * rcl57->speedup / current_speed;
+        pacing->debt += elapsed_ns * rcl57->speedup;
+    }
+
+    // Only whole cycles are run: the fractions and the cycles in excess stay in the debt.
+    while (pacing->debt >= NS_PER_CYCLE) {
+        long long max_cycles = pacing->debt / NS_PER_CYCLE;
+        if (max_cycles > INT_MAX) {
+            max_cycles = INT_MAX;
         }
-    } while (max_cycles > 0);
+        unsigned int speedup = rcl57->speedup;
+        int left = advance_cycles_and_measure(rcl57, (int)max_cycles);
+        pacing->debt -= (max_cycles - left) * NS_PER_CYCLE;
+        // The speedup may have changed in turbo mode.
+        pacing->debt = pacing->debt * rcl57->speedup / speedup;
+    }
+
+    return rcl57_get_wakeup_ms(rcl57) != RCL57_WAKEUP_NEVER;
+}
+
+bool rcl57_advance_ahead(rcl57_t *rcl57, int ms)
+{
+    assert(ms > 0);
+    assert(rcl57->speedup > 0);
+
+    rcl57_pacing_t *pacing = &rcl57->pacing;
+    unsigned int speedup = rcl57->speedup;
+    int cycles = 5 * ms * speedup;
+    int left = advance_cycles_and_measure(rcl57, cycles);
+
+    pacing->debt -= (long long)(cycles - left) * NS_PER_CYCLE;
+    pacing->debt = pacing->debt * rcl57->speedup / speedup;
+
+    // As when it falls behind, the emulation gets at most 'max_catch_up_ms' ahead of the host.
+    long long min_debt = -(long long)pacing->max_catch_up_ms * 1000000 * rcl57->speedup;
+    if (pacing->debt < min_debt) {
+        pacing->dropped_ns -= (min_debt - pacing->debt) / rcl57->speedup;
+        pacing->debt = min_debt;
+    }
+    return rcl57_get_wakeup_ms(rcl57) != RCL57_WAKEUP_NEVER;
+}
+
+double rcl57_get_realtime_factor(rcl57_t *rcl57)
+{
+    rcl57_pacing_t *pacing = &rcl57->pacing;
+
+    if (pacing->paced_ns == 0) return 1;
+
+    double emulated_ns = pacing->paced_ns - pacing->dropped_ns -
+                         (double)pacing->debt / rcl57->speedup;
+    return emulated_ns / pacing->paced_ns;
+}
+
+/**
+ * While pausing or blinking, the ROM counts in A[15] and A[14]: a pause ends when the count
+ * reaches 0x80 and a blinking display toggles when it reaches a multiple of 0x10, a few cycles
+ * later. The cycles per count have been measured on the emulator.
+ */
+#define PAUSE_COUNT_CYCLES 69
+#define PAUSE_END_COUNT 0x80
+#define BLINK_COUNT_CYCLES 139
+#define BLINK_TOGGLE_COUNTS 0x10
+
+int rcl57_get_wakeup_ms(rcl57_t *rcl57)
+{
+    ti57_t *ti57 = &rcl57->ti57;
+    int count = ti57->A[15] << 4 | ti57->A[14];
+    int speed = get_goal_speed(rcl57);
+    unsigned long cycles;
+
+    switch (ti57->activity) {
+    case TI57_POLL_PRESS:
+    case TI57_POLL_RELEASE:
+    case TI57_POLL_RS_RELEASE:
+        // Right after an operation, the display is yet to be refreshed and may start blinking.
+        if (ti57_is_error(ti57) || ti57->current_cycle - ti57->last_disp_cycle > 50) return 0;
+        // The ROM has yet to see the last key event.
+        if (ti57->is_key_pressed != (ti57->activity != TI57_POLL_PRESS)) return 0;
+        return RCL57_WAKEUP_NEVER;
+    case TI57_POLL_PRESS_BLINK:
+        // Be early rather than late: the count may have just been incremented, and right after it
+        // reaches a multiple of 0x10 the display may be about to toggle.
+        count %= BLINK_TOGGLE_COUNTS;
+        if (count == 0) return 0;
+        cycles = (BLINK_TOGGLE_COUNTS - 1 - count) * BLINK_COUNT_CYCLES;
+        break;
+    case TI57_PAUSE:
+        if (count >= PAUSE_END_COUNT) return 0;
+        cycles = (PAUSE_END_COUNT - 1 - count) * PAUSE_COUNT_CYCLES;
+        break;
+    default:
+        return 0;
+    }
 
-    return true;
+    // See 'rcl57_advance' for the number of cycles per millisecond.
+    unsigned long cycles_per_ms = speed < 0 ? 5 * rcl57->speedup : speed == 2 ? 10 : 5;
+    return (int)(cycles / cycles_per_ms);
+}
+
+bool rcl57_is_release_pending(rcl57_t *rcl57)
+{
+    ti57_t *ti57 = &rcl57->ti57;
+
+    // A running program doesn't poll the keyboard.
+    return !ti57->is_key_pressed && ti57->mode != TI57_RUN &&
+           ti57->activity != TI57_POLL_PRESS && ti57->activity != TI57_POLL_PRESS_BLINK;
 }
 
 void rcl57_key_press(rcl57_t *rcl57, int row, int col)
 {
     ti57_t *ti57 = &rcl57->ti57;
 
+    if (rcl57->rewind) {
+        rewind57_record_key(rcl57->rewind, rcl57, row, col);
+    }
+
     if (ti57_get_program_pc(ti57) != 49) {
         rcl57->at_end_program = false;
     }
@@ -116,10 +430,14 @@ void rcl57_key_press(rcl57_t *rcl57, int row, int col)
 
 void rcl57_key_release(rcl57_t *rcl57)
 {
+    if (rcl57->rewind) {
+        rewind57_record_key(rcl57->rewind, rcl57, 0, 0);
+    }
     ti57_key_release(&rcl57->ti57);
 }
 
-char *rcl57_get_display(rcl57_t *rcl57)
+/** Returns the display if it is not the one latched in dA and dB, NULL otherwise. */
+static char *get_enhanced_display(rcl57_t *rcl57)
 {
     ti57_t *ti57 = &rcl57->ti57;
 
@@ -137,17 +455,59 @@ char *rcl57_get_display(rcl57_t *rcl57)
     }
 
     if (ti57->current_cycle - ti57->last_disp_cycle > 250 * rcl57->speedup) {
-        static char str[26];
+        static _Thread_local char str[26];
         strcpy(str, "            ");
         return str;
     }
 
+    return NULL;
+}
+
+char *rcl57_get_display(rcl57_t *rcl57)
+{
+    ti57_t *ti57 = &rcl57->ti57;
+    char *display = get_enhanced_display(rcl57);
+
+    if (display) {
+        return display;
+    }
+
+    ti57_flush_display(ti57);
     return utils57_display_to_str(&ti57->dA, &ti57->dB);
 }
 
+ti57_frame_t *rcl57_get_display_frame(rcl57_t *rcl57)
+{
+    ti57_t *ti57 = &rcl57->ti57;
+    char *display = get_enhanced_display(rcl57);
+
+    if (!display) {
+        return ti57_get_display_frame(ti57);
+    }
+
+    if (rcl57->frame.timestamp == 0 || strcmp(display, rcl57->frame_display) != 0) {
+        strcpy(rcl57->frame_display, display);
+        leds57_get_display_segments(display, rcl57->frame.leds, 12);
+        // Share the display timestamps with the emulator so that both frames never have the same
+        // timestamp.
+        ti57->timestamps.display += 1;
+        rcl57->frame.timestamp = ti57->timestamps.display;
+    }
+    return &rcl57->frame;
+}
+
 void rcl57_clear(rcl57_t *rcl57) {
+    // Keep the timestamps going, so that they never repeat.
+    ti57_timestamps_t timestamps = rcl57->ti57.timestamps;
+
     ti57_init(&rcl57->ti57);
+    rcl57->ti57.timestamps = timestamps;
+    ti57_set_changed(&rcl57->ti57, TI57_ALL_CHANGES);
     rcl57->at_end_program = false;
+
+    if (rcl57->rewind) {
+        rewind57_checkpoint(rcl57->rewind, rcl57);
+    }
 }
 
 int rcl57_get_program_pc(rcl57_t *rcl57) {
@@ -160,3 +520,8 @@ int rcl57_get_program_pc(rcl57_t *rcl57) {
     }
     return pc == 50 ? 49 : pc;
 }
+
+bool rcl57_rewind_to_cycle(rcl57_t *rcl57, unsigned long cycle)
+{
+    return rcl57->rewind && rewind57_rewind_to_cycle(rcl57->rewind, rcl57, cycle);
+}
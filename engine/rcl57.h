@@ -17,6 +17,7 @@
  *     rcl57_advance(rcl57, 20);
  *     // 'update_display' should be defined by the client.
  *     update_display(rcl57_get_display(&rcl57))
+ *     // Optionally, the timer may be delayed by rcl57_get_wakeup_ms(&rcl57).
  *   On key press:
  *     rcl57_key_press(&rcl57, row, col);
  *   On key release:
@@ -67,11 +68,49 @@
 /** In LRN mode, show steps as alphanumeric mnemonics such as "LNX". */
 #define RCL57_ALPHA_LRN_MODE_FLAG              0x20
 
+/**
+ * Run as fast as the host allows: 'rcl57_advance' and 'rcl57_advance_to' measure how many cycles
+ * the host emulates per ms and set 'speedup' so that emulating takes 'turbo.cpu_percent' of the
+ * time. Pauses, traces and the other slowdowns still run at the speed of an actual TI-57.
+ */
+#define RCL57_TURBO_FLAG                       0x40
+
+/** The default of 'cpu_percent' in 'rcl57_turbo_t'. */
+#define RCL57_DEFAULT_TURBO_CPU_PERCENT 50
+
+/** The state of RCL57_TURBO_FLAG. */
+typedef struct rcl57_turbo_s {
+    int cpu_percent;     // The share of the host time to spend emulating, in percent.
+    long cycles_per_ms;  // The number of cycles the host emulates per ms, 0 if not measured yet.
+} rcl57_turbo_t;
+
+/** The default of 'max_catch_up_ms' in 'rcl57_pacing_t'. */
+#define RCL57_DEFAULT_MAX_CATCH_UP_MS 250
+
+/** The state of 'rcl57_advance_to'. */
+typedef struct rcl57_pacing_s {
+    int max_catch_up_ms;       // The longest delay between 2 calls that is caught up with.
+    bool is_started;           // Whether 'rcl57_advance_to' has been called.
+    long long last_time_ns;    // The host time of the last call.
+    long long debt;            // The emulation owed to the host, in ns times the speedup.
+    long long paced_ns;        // The host time since the first call.
+    long long dropped_ns;      // The host time not caught up with, less the time run ahead of it.
+} rcl57_pacing_t;
+
 typedef struct rcl57_s {
     ti57_t ti57;           // The underlying state.
     bool at_end_program;   // In HP mode, indicates that the last step has been executed.
     int options;           // A combination of option flags.
-    unsigned int speedup;  // 1 for the speed of an actual TI-57.
+    unsigned int speedup;  // 1 for the speed of an actual TI-57. Set by the emulator in turbo mode.
+
+    // Frame for displays that are not based on the display registers, such as the run indicator.
+    ti57_frame_t frame;
+    char frame_display[25];  // The display the frame has been built from.
+
+    rcl57_pacing_t pacing;  // Used by 'rcl57_advance_to'.
+    rcl57_turbo_t turbo;    // Used with RCL57_TURBO_FLAG.
+
+    struct rewind57_s *rewind;  // Records the history for rewinding, if not NULL. See rewind57.h.
 } rcl57_t;
 
 /** Initializes or resets a RCL57. */
@@ -80,10 +119,63 @@ void rcl57_init(rcl57_t *rcl57);
 /**
  * Runs the emulator for 'ms' milliseconds.
  *
- * Returns true if calculator is still animating.
+ * Returns true if calculator is still animating, false if nothing will change until a key is
+ * pressed or released.
  */
 bool rcl57_advance(rcl57_t *rcl57, int ms);
 
+/**
+ * Runs the emulator up to 'host_time_ns', a monotonic time of the host in nanoseconds such as
+ * CLOCK_MONOTONIC, instead of a number of milliseconds.
+ *
+ * The emulation owed to the host is carried from one call to the next, including fractions of
+ * cycles and the cycles run in excess, so that the speed does not drift with the jitter of the
+ * host timer. After a stall longer than 'pacing.max_catch_up_ms', the excess is dropped rather
+ * than caught up with. The first call only starts the clock.
+ *
+ * Returns the same as 'rcl57_advance'.
+ */
+bool rcl57_advance_to(rcl57_t *rcl57, long long host_time_ns);
+
+/**
+ * Runs the emulator for 'ms' milliseconds right away, ahead of the host clock, for example to hold
+ * a key long enough for the ROM to see it. The time is taken from the emulation owed to the host:
+ * the next calls to 'rcl57_advance_to' run that much less, so that the emulation doesn't drift. As
+ * when it falls behind, the emulation gets at most 'max_catch_up_ms' ahead of the host.
+ *
+ * Returns the same as 'rcl57_advance'.
+ */
+bool rcl57_advance_ahead(rcl57_t *rcl57, int ms);
+
+/**
+ * Returns the fraction of the host time since the first call to 'rcl57_advance_to' that has
+ * been emulated at the requested speed: 1 when the emulator keeps up, less after stalls.
+ */
+double rcl57_get_realtime_factor(rcl57_t *rcl57);
+
+/** Returned by 'rcl57_get_wakeup_ms' when nothing will change until a key event. */
+#define RCL57_WAKEUP_NEVER -1
+
+/**
+ * Returns in how many milliseconds 'rcl57_advance' should be called next, so that hosts can sleep
+ * in between:
+ * - 0 while the calculator is busy
+ * - the time until the display toggles, while it blinks
+ * - the time until the end of a pause
+ * - RCL57_WAKEUP_NEVER while waiting for a key event, in which case 'rcl57_advance' should be
+ *   called again when a key is pressed or released.
+ *
+ * This is a hint based on the timing of the ROM, which errs on the early side.
+ */
+int rcl57_get_wakeup_ms(rcl57_t *rcl57);
+
+/**
+ * Returns true while the ROM is yet to see the last key release and poll for the next key press. A
+ * key pressed meanwhile may be taken for the previous key still held: hosts that run key presses
+ * ahead of the host clock should run the emulator until this returns false.
+ */
+bool rcl57_is_release_pending(rcl57_t *rcl57);
+
 /** Should be called when a key is pressed (row in 1..8, col in 1..5). */
 void rcl57_key_press(rcl57_t *rcl57, int row, int col);
 
@@ -106,6 +198,14 @@ void rcl57_key_release(rcl57_t *rcl57);
  */
 char *rcl57_get_display(rcl57_t *rcl57);
 
+/**
+ * Returns the display, as returned by 'rcl57_get_display', as a frame of segments.
+ *
+ * The timestamp of the frame changes whenever the display changes. Clients can keep the timestamp
+ * of the frame they have rendered, and repaint only when it differs.
+ */
+ti57_frame_t *rcl57_get_display_frame(rcl57_t *rcl57);
+
 /* Clears the state while preserving the options. */
 void rcl57_clear(rcl57_t *rcl57);
 
@@ -115,4 +215,10 @@ void rcl57_clear(rcl57_t *rcl57);
  */
 int rcl57_get_program_pc(rcl57_t *rcl57);
 
+/**
+ * Rewinds to a past cycle, if a rewinder is attached and has recorded the history back to this
+ * cycle. See rewind57.h.
+ */
+bool rcl57_rewind_to_cycle(rcl57_t *rcl57, unsigned long cycle);
+
 #endif  /* !rcl57_h */
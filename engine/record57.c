@@ -0,0 +1,192 @@
+#include "record57.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "key57.h"
+#include "save57.h"
+#include "stream57.h"
+#include "utils57.h"
+
+#define PRESS_EVENT 1
+#define RELEASE_EVENT 2
+#define END_EVENT 3
+
+static const unsigned char MAGIC[] = {'R', '5', '7', 'R'};
+
+/**
+ * WRITING
+ */
+
+static void put_bytes(record57_t *recorder, const void *bytes, size_t size)
+{
+    if (recorder->is_out_of_memory) return;
+
+    if (recorder->size + size > recorder->capacity) {
+        size_t capacity = recorder->capacity ? recorder->capacity : 1024;
+        while (recorder->size + size > capacity) {
+            capacity *= 2;
+        }
+        unsigned char *data = realloc(recorder->data, capacity);
+        if (data == NULL) {
+            recorder->is_out_of_memory = true;
+            return;
+        }
+        recorder->data = data;
+        recorder->capacity = capacity;
+    }
+    memcpy(recorder->data + recorder->size, bytes, size);
+    recorder->size += size;
+}
+
+/** The most bytes of an event: type, key, cycles and checksum. */
+#define MAX_EVENT_SIZE 16
+
+static void put_event(record57_t *recorder, rcl57_t *rcl57, int type, int row, int col)
+{
+    unsigned char event[MAX_EVENT_SIZE];
+    stream57_writer_t w = {event, sizeof(event), 0, false};
+    unsigned long cycle = rcl57->ti57.current_cycle;
+    unsigned long checksum = record57_get_checksum(rcl57);
+
+    stream57_put_byte(&w, type);
+    if (type == PRESS_EVENT) {
+        stream57_put_byte(&w, row << 4 | col);
+    }
+    stream57_put_varint(&w, cycle - recorder->cycle);
+    for (int i = 0; i < 4; i++) {
+        stream57_put_byte(&w, (checksum >> (8 * i)) & 0xff);
+    }
+    put_bytes(recorder, event, w.pos);
+    recorder->cycle = cycle;
+}
+
+/**
+ * API IMPLEMENTATION
+ */
+
+bool record57_start(record57_t *recorder, rcl57_t *rcl57)
+{
+    unsigned char header[sizeof(MAGIC) + 1 + 10];
+    unsigned char state[SAVE57_MAX_SIZE];
+    stream57_writer_t w = {header, sizeof(header), 0, false};
+
+    memset(recorder, 0, sizeof(record57_t));
+    int state_size = save57_write(rcl57, state, sizeof(state), SAVE57_LOG_FLAG);
+    if (state_size == 0) return false;
+
+    for (int i = 0; i < (int)sizeof(MAGIC); i++) {
+        stream57_put_byte(&w, MAGIC[i]);
+    }
+    stream57_put_byte(&w, RECORD57_VERSION);
+    stream57_put_varint(&w, state_size);
+    put_bytes(recorder, header, w.pos);
+    put_bytes(recorder, state, state_size);
+    recorder->cycle = rcl57->ti57.current_cycle;
+    return !recorder->is_out_of_memory;
+}
+
+void record57_key_press(record57_t *recorder, rcl57_t *rcl57, int row, int col)
+{
+    put_event(recorder, rcl57, PRESS_EVENT, row, col);
+    rcl57_key_press(rcl57, row, col);
+}
+
+void record57_key_release(record57_t *recorder, rcl57_t *rcl57)
+{
+    put_event(recorder, rcl57, RELEASE_EVENT, 0, 0);
+    rcl57_key_release(rcl57);
+}
+
+bool record57_end(record57_t *recorder, rcl57_t *rcl57)
+{
+    put_event(recorder, rcl57, END_EVENT, 0, 0);
+    return !recorder->is_out_of_memory;
+}
+
+void record57_destroy(record57_t *recorder)
+{
+    free(recorder->data);
+    memset(recorder, 0, sizeof(record57_t));
+}
+
+unsigned long record57_get_checksum(rcl57_t *rcl57)
+{
+    log57_t *log = &rcl57->ti57.log;
+    // Not 'rcl57_get_display', which depends on the options and the speedup.
+    char *display = ti57_get_display(&rcl57->ti57);
+    unsigned char count[4];
+    unsigned long crc;
+
+    crc = utils57_crc32(0, display, (int)strlen(display) + 1);
+    for (int i = 0; i < 4; i++) {
+        count[i] = (log->logged_count >> (8 * i)) & 0xff;
+    }
+    crc = utils57_crc32(crc, count, 4);
+    if (log->logged_count > 0) {
+        log57_entry_t *entry = log57_get_entry(log, log->logged_count);
+        unsigned char type_flags[2] = {entry->type, entry->flags};
+        crc = utils57_crc32(crc, entry->message, (int)strlen(entry->message) + 1);
+        crc = utils57_crc32(crc, type_flags, 2);
+    }
+    return utils57_crc32(crc, log->current_op, (int)strlen(log->current_op) + 1);
+}
+
+record57_status_t record57_replay(const unsigned char *data, size_t size, rcl57_t *rcl57,
+                                  long *event_index)
+{
+    stream57_reader_t r = {data, (int)size, 0, false};
+    ti57_t *ti57 = &rcl57->ti57;
+    long index = 0;
+
+    if (event_index) *event_index = 0;
+
+    // Header and starting state.
+    if (size > INT_MAX) return RECORD57_INVALID;
+    if (size < sizeof(MAGIC) || memcmp(data, MAGIC, sizeof(MAGIC)) != 0) return RECORD57_INVALID;
+    r.pos = sizeof(MAGIC);
+    int version = stream57_get_byte(&r);
+    // The checksums of older versions depend on the options and the speedup.
+    if (version != RECORD57_VERSION) return RECORD57_INVALID;
+    unsigned long state_size = stream57_get_varint(&r);
+    if (r.error || state_size > (unsigned long)(r.size - r.pos)) return RECORD57_INVALID;
+    if (!save57_read(rcl57, data + r.pos, (int)state_size)) return RECORD57_INVALID;
+    r.pos += state_size;
+
+    // Events.
+    unsigned long cycle = ti57->current_cycle;
+    for ( ; ; index++) {
+        int type = stream57_get_byte(&r);
+        int row_col = type == PRESS_EVENT ? stream57_get_byte(&r) : 0;
+        cycle += stream57_get_varint(&r);
+        unsigned long checksum = 0;
+        for (int i = 0; i < 4; i++) {
+            checksum |= (unsigned long)stream57_get_byte(&r) << (8 * i);
+        }
+        if (r.error || type < PRESS_EVENT || type > END_EVENT) return RECORD57_INVALID;
+        if (type == PRESS_EVENT &&
+            (row_col == 0 || !key57_is_valid_row_col(row_col >> 4, row_col & 0xf))) {
+            return RECORD57_INVALID;
+        }
+
+        while (ti57->current_cycle < cycle) {
+            ti57_next(ti57);
+        }
+        if (event_index) *event_index = index;
+        if (ti57->current_cycle != cycle || record57_get_checksum(rcl57) != checksum) {
+            return RECORD57_MISMATCH;
+        }
+
+        switch (type) {
+        case PRESS_EVENT:
+            rcl57_key_press(rcl57, row_col >> 4, row_col & 0xf);
+            break;
+        case RELEASE_EVENT:
+            rcl57_key_release(rcl57);
+            break;
+        case END_EVENT:
+            return r.pos == r.size ? RECORD57_OK : RECORD57_INVALID;
+        }
+    }
+}
@@ -0,0 +1,87 @@
+/**
+ * Recording and replaying RCL-57 sessions.
+ *
+ * Since the emulator is deterministic, a session is fully described by its starting state and by
+ * the key presses and releases, with the cycles at which they happen. A recording also holds a
+ * checksum of the display and of the log before each key event, so that a replay can check that
+ * it reproduces the session exactly.
+ *
+ * While recording, the keys should be pressed and released through the recorder. Other changes to
+ * the state, such as loading a program or changing the options, are not recorded: the recording
+ * should be started again after them.
+ *
+ * FORMAT
+ *
+ * Header: 'R' '5' '7' 'R', version
+ * State:  the size of the starting state as a varint, followed by the state (see save57.h)
+ * Events: a sequence of
+ *         - the type: 1 for a key press, 2 for a key release, 3 for the end of the recording
+ *         - for key presses, the row and the column, as 2 4-bit numbers
+ *         - the number of cycles since the previous event, as a varint
+ *         - the checksum before the event, as 4 bytes, little endian
+ */
+
+#ifndef record57_h
+#define record57_h
+
+#include <stddef.h>
+
+#include "rcl57.h"
+
+/** The current version of the format. */
+#define RECORD57_VERSION 2
+
+typedef struct record57_s {
+    unsigned char *data;      // The recording.
+    size_t size;              // The size of the recording.
+    size_t capacity;          // The size allocated for the recording.
+    unsigned long cycle;      // The cycle of the last event.
+    bool is_out_of_memory;    // Whether some of the recording has been lost.
+} record57_t;
+
+/** The result of a replay. */
+typedef enum record57_status_e {
+    RECORD57_OK,          // The session has been replayed exactly.
+    RECORD57_INVALID,     // The recording is corrupted or has been made by another version.
+    RECORD57_MISMATCH,    // The replay differs from the recorded session.
+} record57_status_t;
+
+/**
+ * Starts recording a session of 'rcl57' from its current state. Returns false if out of memory or
+ * if the state can't be saved.
+ */
+bool record57_start(record57_t *recorder, rcl57_t *rcl57);
+
+/** Records a key press and forwards it to 'rcl57'. */
+void record57_key_press(record57_t *recorder, rcl57_t *rcl57, int row, int col);
+
+/** Records a key release and forwards it to 'rcl57'. */
+void record57_key_release(record57_t *recorder, rcl57_t *rcl57);
+
+/**
+ * Records the end of the session, with the final checksum.
+ *
+ * Returns false if the recording is incomplete because memory ran out.
+ */
+bool record57_end(record57_t *recorder, rcl57_t *rcl57);
+
+/** Frees the memory of a recording. */
+void record57_destroy(record57_t *recorder);
+
+/**
+ * Returns the checksum of the display and of the log of 'rcl57'. It doesn't depend on the options
+ * or the speedup.
+ */
+unsigned long record57_get_checksum(rcl57_t *rcl57);
+
+/**
+ * Replays a recording into 'rcl57' as fast as possible.
+ *
+ * On mismatch, 'rcl57' is left in the state where the replay diverged and 'event_index' (if not
+ * NULL) is set to the index of the first event whose checksum differs. Otherwise, it is set to the
+ * number of events replayed.
+ */
+record57_status_t record57_replay(const unsigned char *data, size_t size, rcl57_t *rcl57,
+                                  long *event_index);
+
+#endif  /* !record57_h */
@@ -0,0 +1,186 @@
+#include "rewind57.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static rewind57_checkpoint_t *get_checkpoint(rewind57_t *rewind, long index)
+{
+    return &rewind->checkpoints[index % rewind->checkpoint_capacity];
+}
+
+static rewind57_event_t *get_event(rewind57_t *rewind, long index)
+{
+    return &rewind->events[index % rewind->event_capacity];
+}
+
+/** Whether the key events needed to replay from a checkpoint are still in the journal. */
+static bool is_usable(rewind57_t *rewind, rewind57_checkpoint_t *checkpoint)
+{
+    return checkpoint->event_index >= rewind->first_event;
+}
+
+/** Restores the state of a checkpoint, keeping the log entries and the options. */
+static void restore(rewind57_t *rewind, rcl57_t *rcl57, rewind57_checkpoint_t *checkpoint)
+{
+    log57_t *log = &rcl57->ti57.log;
+    long logged_count = log->logged_count;
+    long log_timestamp = log->timestamp;
+    int options = rcl57->options;
+    unsigned int speedup = rcl57->speedup;
+
+    // Keep the entries that are still in the log.
+    long first = logged_count - LOG57_MAX_ENTRY_COUNT + 1;
+    for (long i = first < 1 ? 1 : first; i <= logged_count; i++) {
+        rewind->entries[i % LOG57_MAX_ENTRY_COUNT] = *log57_get_entry(log, i);
+    }
+
+    save57_read(rcl57, checkpoint->data, checkpoint->size);
+    rcl57->options = options;
+    rcl57->speedup = speedup;
+
+    memcpy(log->entries, rewind->entries, sizeof(log->entries));
+    log->logged_count = checkpoint->logged_count;
+    // The entries overwritten since the checkpoint are lost.
+    long first_lost = checkpoint->logged_count - LOG57_MAX_ENTRY_COUNT + 1;
+    for (long i = first_lost < 1 ? 1 : first_lost; i < first && i <= checkpoint->logged_count; i++) {
+        log->entries[i % LOG57_MAX_ENTRY_COUNT] = *LOG57_BLANK_ENTRY;
+    }
+    if (log->logged_count > 0) {
+        log->entries[log->logged_count % LOG57_MAX_ENTRY_COUNT] = checkpoint->last_entry;
+    }
+    log->timestamp = log_timestamp + 1;
+}
+
+/**
+ * API IMPLEMENTATION
+ */
+
+bool rewind57_init(rewind57_t *rewind, size_t budget, unsigned long interval)
+{
+    memset(rewind, 0, sizeof(rewind57_t));
+    rewind->interval = interval > 0 ? interval : 1;
+
+    // 3/4 of the budget for the checkpoints and the rest for the key events.
+    rewind->checkpoint_capacity = budget / 4 * 3 / sizeof(rewind57_checkpoint_t);
+    if (rewind->checkpoint_capacity < 2) rewind->checkpoint_capacity = 2;
+    rewind->event_capacity = budget / 4 / sizeof(rewind57_event_t);
+    if (rewind->event_capacity < 16) rewind->event_capacity = 16;
+
+    rewind->checkpoints = malloc(rewind->checkpoint_capacity * sizeof(rewind57_checkpoint_t));
+    rewind->events = malloc(rewind->event_capacity * sizeof(rewind57_event_t));
+    rewind->entries = malloc(LOG57_MAX_ENTRY_COUNT * sizeof(log57_entry_t));
+    if (!rewind->checkpoints || !rewind->events || !rewind->entries) {
+        rewind57_destroy(rewind);
+        return false;
+    }
+    return true;
+}
+
+void rewind57_destroy(rewind57_t *rewind)
+{
+    free(rewind->checkpoints);
+    free(rewind->events);
+    free(rewind->entries);
+    memset(rewind, 0, sizeof(rewind57_t));
+}
+
+void rewind57_attach(rewind57_t *rewind, rcl57_t *rcl57)
+{
+    rcl57->rewind = rewind;
+    rewind->first_checkpoint = rewind->checkpoint_count;
+    rewind->first_event = rewind->event_count;
+    rewind57_checkpoint(rewind, rcl57);
+}
+
+void rewind57_checkpoint(rewind57_t *rewind, rcl57_t *rcl57)
+{
+    ti57_t *ti57 = &rcl57->ti57;
+
+    // The cycles went back: the history no longer applies.
+    if (rewind->checkpoint_count > rewind->first_checkpoint &&
+        ti57->current_cycle < get_checkpoint(rewind, rewind->checkpoint_count - 1)->cycle) {
+        rewind->first_checkpoint = rewind->checkpoint_count;
+        rewind->first_event = rewind->event_count;
+    }
+
+    rewind57_checkpoint_t *checkpoint = get_checkpoint(rewind, rewind->checkpoint_count);
+    checkpoint->cycle = ti57->current_cycle;
+    checkpoint->event_index = rewind->event_count;
+    checkpoint->logged_count = ti57->log.logged_count;
+    if (checkpoint->logged_count > 0) {
+        checkpoint->last_entry = *log57_get_entry(&ti57->log, checkpoint->logged_count);
+    }
+    checkpoint->size = save57_write(rcl57, checkpoint->data, sizeof(checkpoint->data), 0);
+
+    rewind->checkpoint_count += 1;
+    if (rewind->checkpoint_count - rewind->first_checkpoint > rewind->checkpoint_capacity) {
+        rewind->first_checkpoint = rewind->checkpoint_count - rewind->checkpoint_capacity;
+    }
+    rewind->next_cycle = ti57->current_cycle + rewind->interval;
+}
+
+void rewind57_record_key(rewind57_t *rewind, rcl57_t *rcl57, int row, int col)
+{
+    rewind57_event_t *event = get_event(rewind, rewind->event_count);
+
+    event->cycle = rcl57->ti57.current_cycle;
+    event->row = row;
+    event->col = col;
+
+    rewind->event_count += 1;
+    if (rewind->event_count - rewind->first_event > rewind->event_capacity) {
+        rewind->first_event = rewind->event_count - rewind->event_capacity;
+    }
+}
+
+unsigned long rewind57_get_first_cycle(rewind57_t *rewind)
+{
+    for (long i = rewind->first_checkpoint; i < rewind->checkpoint_count; i++) {
+        rewind57_checkpoint_t *checkpoint = get_checkpoint(rewind, i);
+        if (is_usable(rewind, checkpoint)) {
+            return checkpoint->cycle;
+        }
+    }
+    return (unsigned long)-1;
+}
+
+bool rewind57_rewind_to_cycle(rewind57_t *rewind, rcl57_t *rcl57, unsigned long cycle)
+{
+    ti57_t *ti57 = &rcl57->ti57;
+
+    if (cycle > ti57->current_cycle) return false;
+
+    // Find the last checkpoint at or before 'cycle'.
+    long index = rewind->checkpoint_count - 1;
+    while (index >= rewind->first_checkpoint && get_checkpoint(rewind, index)->cycle > cycle) {
+        index--;
+    }
+    if (index < rewind->first_checkpoint) return false;
+    rewind57_checkpoint_t *checkpoint = get_checkpoint(rewind, index);
+    if (!is_usable(rewind, checkpoint)) return false;
+
+    restore(rewind, rcl57, checkpoint);
+
+    // Run forward, replaying the key events without recording them again.
+    long event_index = checkpoint->event_index;
+    rcl57->rewind = NULL;
+    while (ti57->current_cycle < cycle) {
+        while (event_index < rewind->event_count &&
+               get_event(rewind, event_index)->cycle <= ti57->current_cycle) {
+            rewind57_event_t *event = get_event(rewind, event_index++);
+            if (event->row) {
+                rcl57_key_press(rcl57, event->row, event->col);
+            } else {
+                rcl57_key_release(rcl57);
+            }
+        }
+        ti57_next(ti57);
+    }
+    rcl57->rewind = rewind;
+
+    // Forget the future.
+    rewind->checkpoint_count = index + 1;
+    rewind->event_count = event_index;
+    rewind->next_cycle = checkpoint->cycle + rewind->interval;
+    return true;
+}
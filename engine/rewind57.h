@@ -0,0 +1,97 @@
+/**
+ * Rewinding a RCL-57 to a past cycle.
+ *
+ * Once attached to a RCL-57, a rewinder records:
+ * - a checkpoint of the core state every 'interval' cycles, in the format of save57.h
+ * - a journal of the key presses and releases
+ * The state at a past cycle is rebuilt from the closest checkpoint by running the emulator forward
+ * and replaying the key events, so a rewind never runs more than 'interval' cycles.
+ *
+ * The checkpoints and the journal are kept in rings of fixed size: the oldest history is dropped
+ * as new history is recorded.
+ *
+ * The log entries are not part of the checkpoints. They are kept from the current log, as long as
+ * they are recent enough to still be in it.
+ *
+ * Changes to the state other than running the emulator and pressing keys, such as loading a
+ * program or changing the options, should be followed by a call to 'rewind57_checkpoint'. This is
+ * done automatically by 'rcl57_clear'.
+ */
+
+#ifndef rewind57_h
+#define rewind57_h
+
+#include <stddef.h>
+
+#include "rcl57.h"
+#include "save57.h"
+
+/** A checkpoint of the core state. */
+typedef struct rewind57_checkpoint_s {
+    unsigned long cycle;               // The cycle of the checkpoint.
+    long event_index;                  // The index of the first key event after the checkpoint.
+    long logged_count;                 // The number of log entries at the time of the checkpoint.
+    log57_entry_t last_entry;          // The last log entry, which may be modified afterwards.
+    int size;                          // The size of the saved state.
+    unsigned char data[SAVE57_MAX_CORE_SIZE];
+} rewind57_checkpoint_t;
+
+/** A key press, or a key release if 'row' is 0. */
+typedef struct rewind57_event_s {
+    unsigned long cycle;
+    signed char row, col;
+} rewind57_event_t;
+
+typedef struct rewind57_s {
+    unsigned long interval;              // The number of cycles between checkpoints.
+    unsigned long next_cycle;            // The cycle of the next checkpoint.
+
+    rewind57_checkpoint_t *checkpoints;  // Ring of checkpoints.
+    int checkpoint_capacity;
+    long checkpoint_count;               // Number of checkpoints since the start.
+    long first_checkpoint;               // Index of the oldest checkpoint.
+
+    rewind57_event_t *events;            // Ring of key events.
+    int event_capacity;
+    long event_count;                    // Number of key events since the start.
+    long first_event;                    // Index of the oldest key event.
+
+    log57_entry_t *entries;              // Used to keep the log entries while rewinding.
+} rewind57_t;
+
+/**
+ * Initializes a rewinder using about 'budget' bytes, with a checkpoint every 'interval' cycles.
+ *
+ * Returns false if out of memory.
+ */
+bool rewind57_init(rewind57_t *rewind, size_t budget, unsigned long interval);
+
+/** Frees the memory of a rewinder. */
+void rewind57_destroy(rewind57_t *rewind);
+
+/** Starts recording the history of 'rcl57', from its current state. */
+void rewind57_attach(rewind57_t *rewind, rcl57_t *rcl57);
+
+/**
+ * Adds a checkpoint of the current state.
+ *
+ * The history is discarded if the current cycle is before the last checkpoint, for instance
+ * after a reset.
+ */
+void rewind57_checkpoint(rewind57_t *rewind, rcl57_t *rcl57);
+
+/** Records a key press at the current cycle, or a key release if 'row' is 0. */
+void rewind57_record_key(rewind57_t *rewind, rcl57_t *rcl57, int row, int col);
+
+/** Returns the earliest cycle that can be rewound to. */
+unsigned long rewind57_get_first_cycle(rewind57_t *rewind);
+
+/**
+ * Rewinds 'rcl57' to the first instruction boundary at or after 'cycle', before the key events at
+ * this cycle. The history after this point is discarded. The options are not affected.
+ *
+ * Returns false, leaving 'rcl57' untouched, if 'cycle' is in the future or too far in the past.
+ */
+bool rewind57_rewind_to_cycle(rewind57_t *rewind, rcl57_t *rcl57, unsigned long cycle);
+
+#endif  /* !rewind57_h */
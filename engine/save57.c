@@ -0,0 +1,335 @@
+#include "save57.h"
+
+#include <string.h>
+
+#include "key57.h"
+#include "stream57.h"
+#include "utils57.h"
+
+/**
+ * FORMAT
+ *
+ * Header:   'R' '5' '7' 'S', version, flags
+ * TI-57:    the registers, 2 digits per byte, and the rest of the state with most numbers as varints
+ * Log:      the state of the log and, with SAVE57_LOG_FLAG, the entries still available
+ * RCL-57:   the RCL-57 state, with SAVE57_RCL57_FLAG
+ * Checksum: CRC-32 of all the previous bytes, little endian
+ *
+ * Caches, such as the decoded steps or the display frame, are not saved.
+ */
+
+/** Set internally if the RCL-57 section is present. */
+#define SAVE57_RCL57_FLAG 0x80
+
+static const unsigned char MAGIC[] = {'R', '5', '7', 'S'};
+
+/**
+ * WRITING
+ */
+
+static void put_reg(stream57_writer_t *w, ti57_reg_t reg)
+{
+    for (int i = 0; i < 16; i += 2) {
+        stream57_put_byte(w, (reg[i] & 0xf) | (reg[i + 1] & 0xf) << 4);
+    }
+}
+
+static void write_ti57(stream57_writer_t *w, ti57_t *ti57)
+{
+    ti57_reg_t *regs[] = {&ti57->A, &ti57->B, &ti57->C, &ti57->D, &ti57->dA, &ti57->dB};
+
+    for (int i = 0; i < 6; i++) {
+        put_reg(w, *regs[i]);
+    }
+    for (int i = 0; i < 8; i++) {
+        put_reg(w, ti57->X[i]);
+    }
+    for (int i = 0; i < 8; i++) {
+        put_reg(w, ti57->Y[i]);
+    }
+
+    stream57_put_byte(w, ti57->RAB);
+    stream57_put_byte(w, ti57->R5);
+    stream57_put_varint(w, ti57->pc);
+    for (int i = 0; i < 3; i++) {
+        stream57_put_varint(w, ti57->stack[i]);
+    }
+    stream57_put_byte(w, ti57->COND |
+                         ti57->is_hex << 1 |
+                         ti57->is_key_pressed << 2 |
+                         ti57->is_lazy_display << 3);
+    stream57_put_byte(w, ti57->row << 4 | ti57->col);
+
+    // The cycles of past events are saved relative to the current cycle.
+    stream57_put_varint(w, ti57->current_cycle);
+    stream57_put_varint(w, ti57->current_cycle - ti57->last_disp_cycle);
+    stream57_put_varint(w, ti57->current_cycle - ti57->last_pause_cycle);
+    stream57_put_varint(w, ti57->current_cycle - ti57->last_eval_cycle);
+    stream57_put_byte(w, ti57->mode << 4 | ti57->activity);
+}
+
+static void write_log(stream57_writer_t *w, log57_t *log, bool with_entries)
+{
+    stream57_put_signed_varint(w, log->timestamp);
+    stream57_put_str(w, log->current_op, sizeof(log->current_op) - 1);
+    stream57_put_byte(w, log->pending_op_key);
+    stream57_put_byte(w, log->is_pending_sec |
+                         log->is_pending_inv << 1 |
+                         log->is_key_logged << 2);
+    stream57_put_signed_varint(w, log->step_at_key_press);
+
+    if (!with_entries) return;
+
+    long count = log57_get_logged_count(log);
+    long first = count - LOG57_MAX_ENTRY_COUNT + 1;
+    if (first < 1) first = 1;
+
+    stream57_put_varint(w, count);
+    for (long i = first; i <= count; i++) {
+        log57_entry_t *entry = log57_get_entry(log, i);
+        stream57_put_byte(w, entry->type);
+        stream57_put_varint(w, entry->flags);
+        stream57_put_str(w, entry->message, sizeof(entry->message) - 1);
+    }
+}
+
+static void write_rcl57(stream57_writer_t *w, rcl57_t *rcl57)
+{
+    stream57_put_byte(w, rcl57->at_end_program);
+    stream57_put_varint(w, rcl57->options);
+    stream57_put_varint(w, rcl57->speedup);
+}
+
+static int write_state(ti57_t *ti57, rcl57_t *rcl57, unsigned char *buf, int size, int flags)
+{
+    stream57_writer_t w = {buf, size, 0, false};
+
+    // The display registers are saved as the user sees them.
+    ti57_flush_display(ti57);
+
+    flags &= SAVE57_LOG_FLAG;
+    if (rcl57) {
+        flags |= SAVE57_RCL57_FLAG;
+    }
+
+    for (int i = 0; i < 4; i++) {
+        stream57_put_byte(&w, MAGIC[i]);
+    }
+    stream57_put_byte(&w, SAVE57_VERSION);
+    stream57_put_byte(&w, flags);
+    write_ti57(&w, ti57);
+    write_log(&w, &ti57->log, flags & SAVE57_LOG_FLAG);
+    if (rcl57) {
+        write_rcl57(&w, rcl57);
+    }
+
+    unsigned long crc = utils57_crc32(0, buf, w.overflow ? 0 : w.pos);
+    for (int i = 0; i < 4; i++) {
+        stream57_put_byte(&w, (crc >> (8 * i)) & 0xff);
+    }
+
+    return w.overflow ? 0 : w.pos;
+}
+
+/**
+ * READING
+ *
+ * Fields added in later versions of the format should only be read if the version of the data is
+ * recent enough, and set to a default value otherwise.
+ */
+
+static void get_reg(stream57_reader_t *r, ti57_reg_t reg)
+{
+    for (int i = 0; i < 16; i += 2) {
+        unsigned char b = stream57_get_byte(r);
+        reg[i] = b & 0xf;
+        reg[i + 1] = b >> 4;
+    }
+}
+
+static void read_ti57(stream57_reader_t *r, ti57_t *ti57)
+{
+    ti57_reg_t *regs[] = {&ti57->A, &ti57->B, &ti57->C, &ti57->D, &ti57->dA, &ti57->dB};
+
+    for (int i = 0; i < 6; i++) {
+        get_reg(r, *regs[i]);
+    }
+    for (int i = 0; i < 8; i++) {
+        get_reg(r, ti57->X[i]);
+    }
+    for (int i = 0; i < 8; i++) {
+        get_reg(r, ti57->Y[i]);
+    }
+
+    ti57->RAB = stream57_get_byte(r) & 0x7;
+    ti57->R5 = stream57_get_byte(r);
+    ti57->pc = stream57_get_varint(r) & 0x7ff;
+    for (int i = 0; i < 3; i++) {
+        ti57->stack[i] = stream57_get_varint(r) & 0x7ff;
+    }
+    unsigned char bits = stream57_get_byte(r);
+    ti57->COND = bits & 0x1;
+    ti57->is_hex = (bits & 0x2) != 0;
+    ti57->is_key_pressed = (bits & 0x4) != 0;
+    ti57->is_lazy_display = (bits & 0x8) != 0;
+    unsigned char row_col = stream57_get_byte(r);
+    ti57->row = row_col >> 4;
+    ti57->col = row_col & 0xf;
+    if (!key57_is_valid_row_col(ti57->row, ti57->col)) {
+        r->error = true;
+    }
+
+    ti57->current_cycle = stream57_get_varint(r);
+    ti57->last_disp_cycle = ti57->current_cycle - stream57_get_varint(r);
+    ti57->last_pause_cycle = ti57->current_cycle - stream57_get_varint(r);
+    ti57->last_eval_cycle = ti57->current_cycle - stream57_get_varint(r);
+    unsigned char mode_activity = stream57_get_byte(r);
+    ti57->mode = mode_activity >> 4;
+    ti57->activity = mode_activity & 0xf;
+    if (ti57->mode > TI57_RUN || ti57->activity > TI57_PAUSE) {
+        r->error = true;
+    }
+}
+
+static void read_log(stream57_reader_t *r, log57_t *log, bool with_entries)
+{
+    log->timestamp = stream57_get_signed_varint(r);
+    stream57_get_str(r, log->current_op, sizeof(log->current_op) - 1);
+    log->pending_op_key = stream57_get_byte(r);
+    if (log->pending_op_key && !key57_is_valid(log->pending_op_key)) {
+        r->error = true;
+    }
+    unsigned char bits = stream57_get_byte(r);
+    log->is_pending_sec = bits & 0x1;
+    log->is_pending_inv = (bits & 0x2) != 0;
+    log->is_key_logged = (bits & 0x4) != 0;
+    log->step_at_key_press = (int)stream57_get_signed_varint(r);
+
+    if (!with_entries) return;
+
+    long count = stream57_get_varint(r);
+    if (count < 0) {
+        r->error = true;
+        return;
+    }
+    long first = count - LOG57_MAX_ENTRY_COUNT + 1;
+    if (first < 1) first = 1;
+
+    log->logged_count = count;
+    for (long i = first; i <= count && !r->error; i++) {
+        log57_entry_t *entry = log57_get_entry(log, i);
+        entry->type = stream57_get_byte(r);
+        entry->flags = (int)stream57_get_varint(r);
+        stream57_get_str(r, entry->message, sizeof(entry->message) - 1);
+        if (entry->type > LOG57_PAUSE) {
+            r->error = true;
+        }
+    }
+}
+
+/** The part of the RCL-57 state that is saved, in addition to the TI-57 state. */
+typedef struct rcl57_fields_s {
+    bool at_end_program;
+    int options;
+    unsigned int speedup;
+} rcl57_fields_t;
+
+static void read_rcl57(stream57_reader_t *r, rcl57_fields_t *fields)
+{
+    fields->at_end_program = stream57_get_byte(r) != 0;
+    fields->options = (int)stream57_get_varint(r);
+    fields->speedup = (unsigned int)stream57_get_varint(r);
+    if (fields->speedup == 0) {
+        r->error = true;
+    }
+}
+
+/** Checks the header and the checksum, returning the flags or -1 if the data is not valid. */
+static int check_state(stream57_reader_t *r)
+{
+    if (r->size < (int)sizeof(MAGIC) + 2 + 4) return -1;
+    if (memcmp(r->buf, MAGIC, sizeof(MAGIC)) != 0) return -1;
+
+    int crc_pos = r->size - 4;
+    unsigned long crc = 0;
+    for (int i = 0; i < 4; i++) {
+        crc |= (unsigned long)r->buf[crc_pos + i] << (8 * i);
+    }
+    if (crc != utils57_crc32(0, r->buf, crc_pos)) return -1;
+
+    r->pos = sizeof(MAGIC);
+    int version = stream57_get_byte(r);
+    if (version < 1 || version > SAVE57_VERSION) return -1;
+
+    // Only read up to the checksum from now on.
+    r->size = crc_pos;
+    return stream57_get_byte(r);
+}
+
+/**
+ * Reads the state into 'ti57' and 'rcl57' (if not NULL).
+ *
+ * 'ti57' is left untouched if the data is invalid.
+ */
+static bool read_state(ti57_t *ti57, rcl57_t *rcl57, const unsigned char *buf, int size)
+{
+    stream57_reader_t r = {buf, size, 0, false};
+    ti57_t state;
+    rcl57_fields_t rcl57_fields = {false, 0, 1};
+
+    int flags = check_state(&r);
+    if (flags < 0) return false;
+
+    ti57_init(&state);
+    read_ti57(&r, &state);
+    read_log(&r, &state.log, flags & SAVE57_LOG_FLAG);
+    if (flags & SAVE57_RCL57_FLAG) {
+        read_rcl57(&r, &rcl57_fields);
+    }
+    if (r.error || r.pos != r.size) return false;
+
+    // Keep the timestamps going, so that they never repeat.
+    state.timestamps = ti57->timestamps;
+    // The cache, if any, belongs to the instance rather than to the state.
+    state.memo = ti57->memo;
+    *ti57 = state;
+    ti57_set_changed(ti57, TI57_ALL_CHANGES);
+
+    if (rcl57 && (flags & SAVE57_RCL57_FLAG)) {
+        rcl57->at_end_program = rcl57_fields.at_end_program;
+        rcl57->options = rcl57_fields.options;
+        rcl57->speedup = rcl57_fields.speedup;
+    }
+    return true;
+}
+
+/**
+ * API IMPLEMENTATION
+ */
+
+int save57_write(rcl57_t *rcl57, unsigned char *buf, int size, int flags)
+{
+    return write_state(&rcl57->ti57, rcl57, buf, size, flags);
+}
+
+bool save57_read(rcl57_t *rcl57, const unsigned char *buf, int size)
+{
+    return read_state(&rcl57->ti57, rcl57, buf, size);
+}
+
+bool save57_is_valid(const unsigned char *buf, int size)
+{
+    stream57_reader_t r = {buf, size, 0, false};
+
+    return check_state(&r) >= 0;
+}
+
+int save57_write_ti57(ti57_t *ti57, unsigned char *buf, int size, int flags)
+{
+    return write_state(ti57, NULL, buf, size, flags);
+}
+
+bool save57_read_ti57(ti57_t *ti57, const unsigned char *buf, int size)
+{
+    return read_state(ti57, NULL, buf, size);
+}
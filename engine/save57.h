@@ -0,0 +1,58 @@
+/**
+ * Saving and restoring the state of a TI-57 or a RCL-57.
+ *
+ * The state is saved into a compact binary format that doesn't depend on the layout of the structs
+ * or on the endianness of the platform:
+ * - a header with a magic number, the version of the format and flags
+ * - the core state, with the registers packed as 4-bit digits and the cycles as varints
+ * - an optional section with the log entries
+ * - a CRC-32 checksum of all of the above
+ *
+ * The core state, including the RCL-57 options, takes less than 512 bytes. States saved with older
+ * versions of the format can always be restored.
+ */
+
+#ifndef save57_h
+#define save57_h
+
+#include "rcl57.h"
+
+/** The current version of the format. */
+#define SAVE57_VERSION 1
+
+/** The maximum size of a saved state, with the log entries. */
+#define SAVE57_MAX_SIZE 24576
+
+/** The maximum size of a saved state, without the log entries. */
+#define SAVE57_MAX_CORE_SIZE 512
+
+/** Include the log entries, which can take up to 20KB, in the saved state. */
+#define SAVE57_LOG_FLAG 0x01
+
+/**
+ * Saves the state of a RCL-57 into 'buf'.
+ *
+ * 'flags' is a combination of SAVE57_*_FLAG flags.
+ *
+ * Returns the size of the saved state, or 0 if 'size' is too small.
+ */
+int save57_write(rcl57_t *rcl57, unsigned char *buf, int size, int flags);
+
+/**
+ * Restores the state of a RCL-57 from 'buf'.
+ *
+ * Returns false, leaving 'rcl57' untouched, if the data is corrupted or has been saved by a newer
+ * version.
+ */
+bool save57_read(rcl57_t *rcl57, const unsigned char *buf, int size);
+
+/** Returns whether 'buf' holds a state, with a valid checksum, that can be restored. */
+bool save57_is_valid(const unsigned char *buf, int size);
+
+/** Same as 'save57_write' for a TI-57. */
+int save57_write_ti57(ti57_t *ti57, unsigned char *buf, int size, int flags);
+
+/** Same as 'save57_read' for a TI-57. */
+bool save57_read_ti57(ti57_t *ti57, const unsigned char *buf, int size);
+
+#endif  /* !save57_h */
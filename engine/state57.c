@@ -109,7 +109,8 @@ bool ti57_is_stopping(ti57_t *ti57)
 
 char *ti57_get_aos_stack(ti57_t *ti57)
 {
-    static char str[46];  // longest example: "0+((((((((((1+((((((((((2+((((((((((3+((((((((((4"
+    // longest example: "0+((((((((((1+((((((((((2+((((((((((3+((((((((((4"
+    static _Thread_local char str[46];
     int k = 0;
     int num_operands = 0;
 
@@ -199,6 +200,7 @@ void ti57_clear_registers(ti57_t *ti57)
         ti57_reg_t *reg = ti57_get_user_reg(ti57, i);
         memset(reg, 0, 14 * sizeof(unsigned char));
     }
+    ti57_set_changed(ti57, TI57_REGISTERS_CHANGE | TI57_AOS_CHANGE);
 }
 
 /**
@@ -220,79 +222,97 @@ int ti57_get_program_ret(ti57_t *ti57, int i)
     return (ti57->X[6 + i][15] << 4) + ti57->X[6 + i][14];
 }
 
-static op57_t ALL_OPS[256];
-
-static void init_ops(void)
+/** Returns the operation of a step, given its code. Safe to call from any thread. */
+static op57_t get_op(unsigned char code)
 {
-    for (int i = 0; i <= 0xff; i++) {
-        op57_t *op = &ALL_OPS[i];
-        if (i < 0x10) {
-            // Digits.
-            op->inv = false;
-            op->key = i;
-            op->d = -1;
-        } else if (i < 0xb0) {
-            // Ops with no parameters.
-            op->inv = (i & 0x08) != 0;
-            op->key = (((i & 0x07) + 1) << 4) | (i & 0xf0) >> 4;
-            op->d = -1;
-        } else {
-            // Register ops: RCL, PRD, SUM, EXC and STO.
-            static key57_t keys[] = {0x33, 0x38, 0x34, 0x39, 0x32};
-            op->inv = (i & 0x08) != 0;
-            op->key = keys[(i >> 4) - 0xb];
-            op->d = i & 0x07;
-        }
-    }
-
     // LBL, GTO, SBR and FIX.
-    static int start_indices[] = {0x27, 0x2f, 0x77, 0x7f};
-    static key57_t keys[] = {0x86, 0x51, 0x61, 0x48};
-    static int offsets[] = {0, -1, 15, 31, -2, 14, 30, -3, 13, 29};
+    static const int start_indices[] = {0x27, 0x2f, 0x77, 0x7f};
+    static const key57_t param_keys[] = {0x86, 0x51, 0x61, 0x48};
+    static const int offsets[] = {0, -1, 15, 31, -2, 14, 30, -3, 13, 29};
+    // Register ops: RCL, PRD, SUM, EXC and STO.
+    static const key57_t register_keys[] = {0x33, 0x38, 0x34, 0x39, 0x32};
+    op57_t op;
+
     for (int i = 0; i < 4; i++) {
         for (int j = 0; j < 10; j++) {
-            op57_t *op = &ALL_OPS[start_indices[i] + offsets[j]];
-            op->inv = false;
-            op->key = keys[i];
-            op->d = j;
+            if (code == start_indices[i] + offsets[j]) {
+                op.inv = false;
+                op.key = param_keys[i];
+                op.d = j;
+                return op;
+            }
         }
     }
+
+    if (code < 0x10) {
+        // Digits.
+        op.inv = false;
+        op.key = code;
+        op.d = -1;
+    } else if (code < 0xb0) {
+        // Ops with no parameters.
+        op.inv = (code & 0x08) != 0;
+        op.key = (((code & 0x07) + 1) << 4) | (code & 0xf0) >> 4;
+        op.d = -1;
+    } else {
+        op.inv = (code & 0x08) != 0;
+        op.key = register_keys[(code >> 4) - 0xb];
+        op.d = code & 0x07;
+    }
+    return op;
 }
 
-static op57_t *get_op(unsigned char index)
+/** Decodes the 50 steps stored in 'Y', as well as the index of the last non-zero step. */
+static void decode_program(ti57_t *ti57)
 {
-    return &ALL_OPS[index];
+    // Steps 0..47 are stored in Y[0]..Y[5], 8 steps per register starting with the high digits.
+    for (int step = 0; step < 48; step++) {
+        ti57_reg_t *reg = &ti57->Y[step / 8];
+        int i = 15 - 2 * (step % 8);
+        ti57->program[step] = get_op(((*reg)[i] << 4) | (*reg)[i-1]);
+    }
+
+    // Steps 48 and 49 are stored in the high digits of Y[6] and Y[7].
+    ti57->program[48] = get_op((ti57->Y[6][15] << 4) | ti57->Y[6][14]);
+    ti57->program[49] = get_op((ti57->Y[7][15] << 4) | ti57->Y[7][14]);
+
+    int last_index = 49;
+    while (last_index >= 0 && ti57->program[last_index].key == 0) {
+        last_index -= 1;
+    }
+    ti57->program_last_index = last_index;
+
+    ti57->is_program_decoded = true;
 }
 
 op57_t *ti57_get_program_op(ti57_t *ti57, int step)
 {
-    int i;
-    ti57_reg_t *reg;
-    static bool initialized = false;
-
     assert(0 <= step && step <= 49);
 
-    if (!initialized) {
-        init_ops();
-        initialized = true;
+    if (!ti57->is_program_decoded) {
+        decode_program(ti57);
     }
-    if (step == 49) {
-        reg = &ti57->Y[7];
-        i = 15;
-    } else {
-        reg = &ti57->Y[step / 8];
-        i = 15 - 2 * (step % 8);
-    }
-    return get_op(((*reg)[i] << 4) | (*reg)[i-1]);
+    return &ti57->program[step];
+}
+
+void ti57_set_program_step(ti57_t *ti57, int step, unsigned char code)
+{
+    assert(0 <= step && step <= 49);
+
+    // The same layout as in 'decode_program'.
+    ti57_reg_t *reg = step < 48 ? &ti57->Y[step / 8] : &ti57->Y[step - 42];
+    int i = step < 48 ? 15 - 2 * (step % 8) : 15;
+    (*reg)[i] = code >> 4;
+    (*reg)[i-1] = code & 0x0f;
+    ti57_set_changed(ti57, TI57_PROGRAM_CHANGE);
 }
 
 int ti57_get_program_last_index(ti57_t *ti57)
 {
-    int last_index = 49;
-    while (last_index >= 0 && ti57_get_program_op(ti57, last_index)->key == 0) {
-        last_index -= 1;
+    if (!ti57->is_program_decoded) {
+        decode_program(ti57);
     }
-    return last_index;
+    return ti57->program_last_index;
 }
 
 void ti57_clear_program(ti57_t *ti57)
@@ -327,4 +347,46 @@ void ti57_clear_program(ti57_t *ti57)
     if (ti57_is_op_edit_in_lrn(ti57)) {
         ti57->C[14] &= 0xe;
     }
+
+    ti57_set_changed(ti57, TI57_PROGRAM_CHANGE);
+}
+
+/**
+ * CHANGES
+ */
+
+ti57_timestamps_t ti57_get_timestamps(ti57_t *ti57)
+{
+    return ti57->timestamps;
+}
+
+int ti57_changes_since(ti57_t *ti57, ti57_timestamps_t *snapshot)
+{
+    ti57_timestamps_t *timestamps = &ti57->timestamps;
+    int changes = 0;
+
+    ti57_flush_display(ti57);
+
+    // Compare for equality, since the timestamps go back to 0 when the state is reset.
+    if (timestamps->registers != snapshot->registers) changes |= TI57_REGISTERS_CHANGE;
+    if (timestamps->program != snapshot->program) changes |= TI57_PROGRAM_CHANGE;
+    if (timestamps->display != snapshot->display) changes |= TI57_DISPLAY_CHANGE;
+    if (timestamps->modes != snapshot->modes) changes |= TI57_MODES_CHANGE;
+    if (timestamps->aos != snapshot->aos) changes |= TI57_AOS_CHANGE;
+    return changes;
+}
+
+void ti57_set_changed(ti57_t *ti57, int changes)
+{
+    ti57_timestamps_t *timestamps = &ti57->timestamps;
+
+    if (changes & TI57_REGISTERS_CHANGE) timestamps->registers += 1;
+    if (changes & TI57_PROGRAM_CHANGE) {
+        // The steps may have changed.
+        ti57->is_program_decoded = false;
+        timestamps->program += 1;
+    }
+    if (changes & TI57_DISPLAY_CHANGE) timestamps->display += 1;
+    if (changes & TI57_MODES_CHANGE) timestamps->modes += 1;
+    if (changes & TI57_AOS_CHANGE) timestamps->aos += 1;
 }
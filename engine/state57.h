@@ -46,27 +46,75 @@ typedef enum ti57_trig_e {
     TI57_GRAD,
 } ti57_trig_t;
 
-/** The state of a TI-57. */
+/**
+ * The display as a frame of segments.
+ *
+ * For each of the 12 LEDs, from left to right, the segments that are on as returned by
+ * 'leds57_get_segments', with the LEDS57_DOT bit set if the LED is followed by a decimal point.
+ */
+typedef struct ti57_frame_s {
+    unsigned short leds[12];
+    long timestamp;  // Changes whenever the frame changes.
+} ti57_frame_t;
+
+/**
+ * Parts of the state whose changes are tracked, see 'ti57_changes_since'.
+ */
+#define TI57_REGISTERS_CHANGE  0x01  // The user registers.
+#define TI57_PROGRAM_CHANGE    0x02  // The steps, the program counter and the return addresses.
+#define TI57_DISPLAY_CHANGE    0x04  // The display latch 'dA' and 'dB'.
+#define TI57_MODES_CHANGE      0x08  // The mode, the activity and the flags.
+#define TI57_AOS_CHANGE        0x10  // The AOS stack.
+#define TI57_ALL_CHANGES       0x1f
+
+/** Timestamps incremented whenever the corresponding part of the state changes. */
+typedef struct ti57_timestamps_s {
+    long registers;
+    long program;
+    long display;
+    long modes;
+    long aos;
+} ti57_timestamps_t;
+
+/**
+ * The state of a TI-57.
+ *
+ * The fields used by most instructions come first, in 2 cache lines, followed by the fields that
+ * are used less often. Many instances can be allocated together with arena57.h.
+ */
 typedef struct ti57_s {
-    // The internal state of a TI-57.
-    ti57_reg_t A, B, C, D;           // Operational registers.
-    ti57_reg_t X[8], Y[8];           // Storage registers.
-    unsigned char RAB;               // Register Address Buffer (3-bit).
-    unsigned char R5;                // Auxiliary 8-bit register.
+    // The internal state of a TI-57 used by most instructions.
+    _Alignas(64) ti57_reg_t A;       // Operational registers.
+    ti57_reg_t B, C, D;
     ti57_address_t pc;               // Internal program counter.
     ti57_address_t stack[3];         // Subroutine stack.
+    unsigned char RAB;               // Register Address Buffer (3-bit).
+    unsigned char R5;                // Auxiliary 8-bit register.
     bool COND;                       // Conditional latch.
     bool is_hex;                     // Arithmetic done in base 16 instead of 10.
-    int row, col;                    // Row (1..8) and column (1..5) of last pressed key.
     bool is_key_pressed;             // Whether a key is being pressed by the user.
+    bool is_lazy_display;            // Whether latching the display may be deferred in RUN mode.
+    bool is_display_pending;         // Whether DISP has been executed but A and B not latched yet.
+    int row, col;                    // Row (1..8) and column (1..5) of last pressed key.
+    unsigned long current_cycle;     // The number of cycles the emulator has been running for.
+    ti57_mode_t mode;                // The current mode.
+    ti57_activity_t activity;        // The current activity.
+    unsigned short status;           // The digits B[15], C[14], C[15] and D[15] at the last check.
 
+    // The rest of the internal state.
+    _Alignas(64) ti57_reg_t X[8];    // Storage registers.
+    ti57_reg_t Y[8];
     ti57_reg_t dA, dB;               // Copy of A and B for display purposes.
-    unsigned long current_cycle;     // The number of cycles the emulator has been running for.
     unsigned long last_disp_cycle;   // The cycle DISP (display refresh) was executed last.
     unsigned long last_pause_cycle;  // The cycle the calculator was last paused.
     unsigned long last_eval_cycle;   // The cycle the calculator was last in eval mode.
-    ti57_mode_t mode;                // The current mode.
-    ti57_activity_t activity;        // The current activity.
+
+    ti57_frame_t frame;              // The segments of the LEDs, based on dA and dB.
+    op57_t program[50];              // The decoded steps, valid if 'is_program_decoded'.
+    int program_last_index;          // The index of the last non-zero step, valid if 'is_program_decoded'.
+    bool is_program_decoded;         // Whether the steps in 'Y' have been decoded.
+    ti57_timestamps_t timestamps;    // Used to track changes to the state.
+    struct memo57_s *memo;           // The cache of the pure subroutines of the ROM, or NULL.
 
     log57_t log;                     // The sequence of operations and results.
 } ti57_t;
@@ -167,9 +215,33 @@ int ti57_get_program_ret(ti57_t *ti57, int i);
 /** Returns the operation at a given step (step in 0..49). */
 op57_t *ti57_get_program_op(ti57_t *ti57, int step);
 
+/** Sets a step (in 0..49) to an operation given by its code in 'Y', such as 0x17 for R/S. */
+void ti57_set_program_step(ti57_t *ti57, int step, unsigned char code);
+
 /** Returns the index of the last non-zero step, or -1 if none,*/
 int ti57_get_program_last_index(ti57_t *ti57);
 
 void ti57_clear_program(ti57_t *ti57);
 
+/**
+ * CHANGES
+ */
+
+/**
+ * Returns a snapshot of the timestamps of the state.
+ *
+ * Clients can keep the snapshot and later pass it to 'ti57_changes_since', to update the UI only when
+ * needed.
+ */
+ti57_timestamps_t ti57_get_timestamps(ti57_t *ti57);
+
+/** Returns the parts of the state that have changed since 'snapshot', as TI57_*_CHANGE flags. */
+int ti57_changes_since(ti57_t *ti57, ti57_timestamps_t *snapshot);
+
+/**
+ * Should be called after modifying the state directly, instead of through the ROM, with the parts
+ * that have changed as TI57_*_CHANGE flags.
+ */
+void ti57_set_changed(ti57_t *ti57, int changes);
+
 #endif  /* !state57_h */
@@ -0,0 +1,87 @@
+#include "stream57.h"
+
+#include <string.h>
+
+/**
+ * WRITING
+ */
+
+void stream57_put_byte(stream57_writer_t *w, unsigned char b)
+{
+    if (w->pos >= w->size) {
+        w->overflow = true;
+        return;
+    }
+    w->buf[w->pos++] = b;
+}
+
+void stream57_put_varint(stream57_writer_t *w, unsigned long n)
+{
+    while (n >= 0x80) {
+        stream57_put_byte(w, (n & 0x7f) | 0x80);
+        n >>= 7;
+    }
+    stream57_put_byte(w, n);
+}
+
+void stream57_put_signed_varint(stream57_writer_t *w, long n)
+{
+    stream57_put_varint(w, n < 0 ? ((unsigned long)(-(n + 1)) << 1) | 1 : (unsigned long)n << 1);
+}
+
+void stream57_put_str(stream57_writer_t *w, const char *str, int max_len)
+{
+    int len = (int)strnlen(str, max_len);
+
+    stream57_put_byte(w, len);
+    for (int i = 0; i < len; i++) {
+        stream57_put_byte(w, str[i]);
+    }
+}
+
+/**
+ * READING
+ */
+
+unsigned char stream57_get_byte(stream57_reader_t *r)
+{
+    if (r->pos >= r->size) {
+        r->error = true;
+        return 0;
+    }
+    return r->buf[r->pos++];
+}
+
+unsigned long stream57_get_varint(stream57_reader_t *r)
+{
+    unsigned long n = 0;
+
+    for (int shift = 0; shift < 64; shift += 7) {
+        unsigned char b = stream57_get_byte(r);
+        n |= (unsigned long)(b & 0x7f) << shift;
+        if (!(b & 0x80)) return n;
+    }
+    r->error = true;
+    return 0;
+}
+
+long stream57_get_signed_varint(stream57_reader_t *r)
+{
+    unsigned long n = stream57_get_varint(r);
+
+    return (n & 1) ? -(long)(n >> 1) - 1 : (long)(n >> 1);
+}
+
+void stream57_get_str(stream57_reader_t *r, char *str, int max_len)
+{
+    int len = stream57_get_byte(r);
+
+    if (len > max_len) {
+        r->error = true;
+        len = 0;
+    }
+    for (int i = 0; i < len; i++) {
+        str[i] = stream57_get_byte(r);
+    }
+    str[len] = 0;
+}
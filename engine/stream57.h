@@ -0,0 +1,48 @@
+/**
+ * Byte streams shared by the binary formats of save57, record57 and sync57.
+ *
+ * Writing past the end of the buffer sets 'overflow' and reading past the end of the data sets
+ * 'error', so that the callers can write or read everything and check once at the end.
+ */
+
+#ifndef stream57_h
+#define stream57_h
+
+#include <stdbool.h>
+
+typedef struct stream57_writer_s {
+    unsigned char *buf;
+    int size;
+    int pos;
+    bool overflow;
+} stream57_writer_t;
+
+typedef struct stream57_reader_s {
+    const unsigned char *buf;
+    int size;
+    int pos;
+    bool error;
+} stream57_reader_t;
+
+void stream57_put_byte(stream57_writer_t *w, unsigned char b);
+
+/** Writes 'n' 7 bits at a time, least significant first, with the high bit set but in the last. */
+void stream57_put_varint(stream57_writer_t *w, unsigned long n);
+
+/** Writes a zigzag encoded varint, so that small negative numbers remain small. */
+void stream57_put_signed_varint(stream57_writer_t *w, long n);
+
+/** Writes the length of 'str', up to 'max_len', on a byte and then its characters. */
+void stream57_put_str(stream57_writer_t *w, const char *str, int max_len);
+
+unsigned char stream57_get_byte(stream57_reader_t *r);
+
+/** Reads a varint, setting 'error' if it doesn't fit into an unsigned long. */
+unsigned long stream57_get_varint(stream57_reader_t *r);
+
+long stream57_get_signed_varint(stream57_reader_t *r);
+
+/** Reads a string into 'str', which has room for 'max_len' characters and the terminating 0. */
+void stream57_get_str(stream57_reader_t *r, char *str, int max_len);
+
+#endif  /* !stream57_h */
@@ -0,0 +1,347 @@
+#include "sync57.h"
+
+#include <string.h>
+
+#include "key57.h"
+#include "stream57.h"
+
+/**
+ * FORMAT
+ *
+ * Header:    version, the current cycle and the log timestamp of the base
+ * Registers: a bitmap of the changed registers, then for each one a bitmap of the changed digits
+ *            followed by these digits, 2 per byte
+ * State:     the rest of the state, as in save57.c, with the cycles relative to the base
+ * Log:       whether the log changed and if so, its state and the entries since the base
+ */
+
+/**
+ * STATE
+ */
+
+#define REG_COUNT 22
+
+/** Returns the registers in the order they appear in the bitmap. */
+static void get_regs(ti57_t *ti57, ti57_reg_t *regs[REG_COUNT])
+{
+    regs[0] = &ti57->A;
+    regs[1] = &ti57->B;
+    regs[2] = &ti57->C;
+    regs[3] = &ti57->D;
+    for (int i = 0; i < 8; i++) {
+        regs[4 + i] = &ti57->X[i];
+        regs[12 + i] = &ti57->Y[i];
+    }
+    regs[20] = &ti57->dA;
+    regs[21] = &ti57->dB;
+}
+
+static bool is_log_state_equal(log57_t *log1, log57_t *log2)
+{
+    return log1->timestamp == log2->timestamp &&
+           log1->logged_count == log2->logged_count &&
+           strcmp(log1->current_op, log2->current_op) == 0 &&
+           log1->pending_op_key == log2->pending_op_key &&
+           log1->is_pending_sec == log2->is_pending_sec &&
+           log1->is_pending_inv == log2->is_pending_inv &&
+           log1->is_key_logged == log2->is_key_logged &&
+           log1->step_at_key_press == log2->step_at_key_press;
+}
+
+/** Compares the fields of two entries, ignoring the bytes after the end of the messages. */
+static bool is_entry_equal(log57_entry_t *entry1, log57_entry_t *entry2)
+{
+    return entry1->type == entry2->type &&
+           entry1->flags == entry2->flags &&
+           strcmp(entry1->message, entry2->message) == 0;
+}
+
+/** Returns the index of the first log entry that may differ from the base. */
+static long get_first_new_entry(log57_t *base, log57_t *log)
+{
+    long first_available = log->logged_count - LOG57_MAX_ENTRY_COUNT + 1;
+    long first = 1;
+
+    // The log has only been appended to, except maybe for the last entry of the base.
+    if (log->timestamp >= base->timestamp && log->logged_count >= base->logged_count) {
+        long index = base->logged_count - 1;
+        if (index < 1 || index < first_available ||
+            is_entry_equal(log57_get_entry(base, index), log57_get_entry(log, index))) {
+            first = base->logged_count;
+        }
+    }
+    if (first < first_available) first = first_available;
+    if (first < 1) first = 1;
+    return first;
+}
+
+static unsigned short get_status(ti57_t *ti57)
+{
+    return ti57->B[15] | ti57->C[14] << 4 | ti57->C[15] << 8 | ti57->D[15] << 12;
+}
+
+/** Returns the TI57_*_CHANGE flags for changes in some digits of the register at 'index'. */
+static int get_register_changes(ti57_t *ti57, int index, int mask)
+{
+    int changes = 0;
+
+    if (index >= 4 && index < 12) {
+        // X: user registers in the low digits of X[2]..X[7], AOS stack in X[0]..X[3], fix and trig
+        // in the high digits of X[4] and program counters in those of X[5]..X[7].
+        int i = index - 4;
+        if (i >= 2 && (mask & 0x3fff)) changes |= TI57_REGISTERS_CHANGE;
+        if (i <= 3 && mask) changes |= TI57_AOS_CHANGE;
+        if (i == 4 && (mask & 0xc000)) changes |= TI57_MODES_CHANGE;
+        if (i > 4 && (mask & 0xc000)) ti57->timestamps.program += 1;
+    } else if (index >= 12 && index < 20) {
+        // Y: steps in Y[0]..Y[5] and in the high digits of Y[6] and Y[7], user registers in the low
+        // digits of Y[6] and Y[7].
+        int i = index - 12;
+        if (mask & (i < 6 ? 0xffff : 0xc000)) changes |= TI57_PROGRAM_CHANGE;
+        if (i >= 6 && (mask & 0x3fff)) changes |= TI57_REGISTERS_CHANGE;
+    } else if (index >= 20) {
+        changes |= TI57_DISPLAY_CHANGE;
+    }
+    return changes;
+}
+
+/** Reads a delta, applying it to 'ti57' only if 'apply' is true. Returns false if invalid. */
+static bool read_delta(ti57_t *ti57, stream57_reader_t *r, bool apply)
+{
+    ti57_reg_t *regs[REG_COUNT];
+    int changes = 0;
+
+    get_regs(ti57, regs);
+    unsigned short status = get_status(ti57);
+
+    // Header.
+    if (stream57_get_byte(r) != SYNC57_VERSION) return false;
+    unsigned long base_cycle = stream57_get_varint(r);
+    long base_log_timestamp = stream57_get_signed_varint(r);
+    if (base_cycle != ti57->current_cycle || base_log_timestamp != ti57->log.timestamp) {
+        return false;
+    }
+
+    // Registers.
+    unsigned long reg_bitmap = stream57_get_varint(r);
+    if (reg_bitmap >> REG_COUNT) return false;
+    for (int k = 0; k < REG_COUNT && !r->error; k++) {
+        if (!(reg_bitmap & (1ul << k))) continue;
+
+        int mask = stream57_get_byte(r) | stream57_get_byte(r) << 8;
+        int n = 0;
+        unsigned char b = 0;
+        for (int i = 0; i < 16; i++) {
+            if (!(mask & (1 << i))) continue;
+            if (n++ % 2 == 0) b = stream57_get_byte(r);
+            unsigned char digit = (n % 2) ? b & 0xf : b >> 4;
+            if (apply) (*regs[k])[i] = digit;
+        }
+        if (apply) changes |= get_register_changes(ti57, k, mask);
+    }
+
+    // State.
+    unsigned char RAB = stream57_get_byte(r) & 0x7;
+    unsigned char R5 = stream57_get_byte(r);
+    ti57_address_t pc = stream57_get_varint(r) & 0x7ff;
+    ti57_address_t stack[3];
+    for (int i = 0; i < 3; i++) {
+        stack[i] = stream57_get_varint(r) & 0x7ff;
+    }
+    unsigned char bits = stream57_get_byte(r);
+    unsigned char row_col = stream57_get_byte(r);
+    unsigned long current_cycle = ti57->current_cycle + stream57_get_signed_varint(r);
+    unsigned long last_disp_cycle = current_cycle - stream57_get_varint(r);
+    unsigned long last_pause_cycle = current_cycle - stream57_get_varint(r);
+    unsigned long last_eval_cycle = current_cycle - stream57_get_varint(r);
+    unsigned char mode_activity = stream57_get_byte(r);
+    if ((mode_activity >> 4) > TI57_RUN || (mode_activity & 0xf) > TI57_PAUSE) return false;
+    if (!key57_is_valid_row_col(row_col >> 4, row_col & 0xf)) return false;
+
+    if (apply) {
+        ti57->RAB = RAB;
+        ti57->R5 = R5;
+        ti57->pc = pc;
+        memcpy(ti57->stack, stack, sizeof(stack));
+        ti57->COND = bits & 0x1;
+        ti57->is_hex = (bits & 0x2) != 0;
+        ti57->is_key_pressed = (bits & 0x4) != 0;
+        ti57->is_lazy_display = (bits & 0x8) != 0;
+        ti57->is_display_pending = (bits & 0x10) != 0;
+        ti57->row = row_col >> 4;
+        ti57->col = row_col & 0xf;
+        ti57->current_cycle = current_cycle;
+        ti57->last_disp_cycle = last_disp_cycle;
+        ti57->last_pause_cycle = last_pause_cycle;
+        ti57->last_eval_cycle = last_eval_cycle;
+        if (ti57->mode != (mode_activity >> 4) || ti57->activity != (mode_activity & 0xf)) {
+            changes |= TI57_MODES_CHANGE;
+        }
+        ti57->mode = mode_activity >> 4;
+        ti57->activity = mode_activity & 0xf;
+    }
+
+    // Log.
+    if (stream57_get_byte(r)) {
+        log57_t *log = &ti57->log;
+        log57_t state;
+
+        state.timestamp = stream57_get_signed_varint(r);
+        stream57_get_str(r, state.current_op, sizeof(state.current_op) - 1);
+        state.pending_op_key = stream57_get_byte(r);
+        unsigned char log_bits = stream57_get_byte(r);
+        state.step_at_key_press = (int)stream57_get_signed_varint(r);
+        long count = stream57_get_varint(r);
+        long first = stream57_get_varint(r);
+        if (state.pending_op_key && !key57_is_valid(state.pending_op_key)) return false;
+        if (count < 0 || first < 1 || first < count - LOG57_MAX_ENTRY_COUNT + 1) return false;
+
+        if (apply) {
+            log->timestamp = state.timestamp;
+            strcpy(log->current_op, state.current_op);
+            log->pending_op_key = state.pending_op_key;
+            log->is_pending_sec = log_bits & 0x1;
+            log->is_pending_inv = (log_bits & 0x2) != 0;
+            log->is_key_logged = (log_bits & 0x4) != 0;
+            log->step_at_key_press = state.step_at_key_press;
+            log57_detach(log);
+            log->logged_count = count;
+        }
+        for (long i = first; i <= count && !r->error; i++) {
+            log57_entry_t entry;
+            memset(&entry, 0, sizeof(entry));
+            entry.type = stream57_get_byte(r);
+            entry.flags = (int)stream57_get_varint(r);
+            stream57_get_str(r, entry.message, sizeof(entry.message) - 1);
+            if (entry.type > LOG57_PAUSE) return false;
+            if (apply) *log57_get_entry(log, i) = entry;
+        }
+    }
+
+    if (r->error || r->pos != r->size) return false;
+
+    if (apply) {
+        unsigned short status_changes = status ^ get_status(ti57);
+        if (status_changes & 0x0fff) changes |= TI57_MODES_CHANGE;
+        if (status_changes & 0xf021) changes |= TI57_AOS_CHANGE;
+        ti57->status = get_status(ti57);
+        if (changes & TI57_DISPLAY_CHANGE) {
+            // Rebuilt on demand.
+            ti57->frame.timestamp = 0;
+        }
+        if (changes) {
+            ti57_set_changed(ti57, changes);
+        }
+    }
+    return true;
+}
+
+/**
+ * API IMPLEMENTATION
+ */
+
+int sync57_diff(ti57_t *base, ti57_t *ti57, unsigned char *buf, int size)
+{
+    stream57_writer_t w = {buf, size, 0, false};
+    ti57_reg_t *base_regs[REG_COUNT];
+    ti57_reg_t *regs[REG_COUNT];
+
+    get_regs(base, base_regs);
+    get_regs(ti57, regs);
+
+    // Header.
+    stream57_put_byte(&w, SYNC57_VERSION);
+    stream57_put_varint(&w, base->current_cycle);
+    stream57_put_signed_varint(&w, base->log.timestamp);
+
+    // Registers.
+    unsigned long reg_bitmap = 0;
+    for (int k = 0; k < REG_COUNT; k++) {
+        if (memcmp(*regs[k], *base_regs[k], sizeof(ti57_reg_t)) != 0) {
+            reg_bitmap |= 1ul << k;
+        }
+    }
+    stream57_put_varint(&w, reg_bitmap);
+    for (int k = 0; k < REG_COUNT; k++) {
+        if (!(reg_bitmap & (1ul << k))) continue;
+
+        int mask = 0;
+        for (int i = 0; i < 16; i++) {
+            if ((*regs[k])[i] != (*base_regs[k])[i]) mask |= 1 << i;
+        }
+        stream57_put_byte(&w, mask & 0xff);
+        stream57_put_byte(&w, mask >> 8);
+
+        int n = 0;
+        unsigned char b = 0;
+        for (int i = 0; i < 16; i++) {
+            if (!(mask & (1 << i))) continue;
+            b |= ((*regs[k])[i] & 0xf) << (4 * (n % 2));
+            if (n++ % 2 == 1) {
+                stream57_put_byte(&w, b);
+                b = 0;
+            }
+        }
+        if (n % 2) stream57_put_byte(&w, b);
+    }
+
+    // State.
+    stream57_put_byte(&w, ti57->RAB);
+    stream57_put_byte(&w, ti57->R5);
+    stream57_put_varint(&w, ti57->pc);
+    for (int i = 0; i < 3; i++) {
+        stream57_put_varint(&w, ti57->stack[i]);
+    }
+    stream57_put_byte(&w, ti57->COND |
+                          ti57->is_hex << 1 |
+                          ti57->is_key_pressed << 2 |
+                          ti57->is_lazy_display << 3 |
+                          ti57->is_display_pending << 4);
+    stream57_put_byte(&w, ti57->row << 4 | ti57->col);
+    stream57_put_signed_varint(&w, (long)(ti57->current_cycle - base->current_cycle));
+    stream57_put_varint(&w, ti57->current_cycle - ti57->last_disp_cycle);
+    stream57_put_varint(&w, ti57->current_cycle - ti57->last_pause_cycle);
+    stream57_put_varint(&w, ti57->current_cycle - ti57->last_eval_cycle);
+    stream57_put_byte(&w, ti57->mode << 4 | ti57->activity);
+
+    // Log.
+    log57_t *log = &ti57->log;
+    if (is_log_state_equal(&base->log, log)) {
+        stream57_put_byte(&w, 0);
+    } else {
+        stream57_put_byte(&w, 1);
+        stream57_put_signed_varint(&w, log->timestamp);
+        stream57_put_str(&w, log->current_op, sizeof(log->current_op) - 1);
+        stream57_put_byte(&w, log->pending_op_key);
+        stream57_put_byte(&w, log->is_pending_sec |
+                              log->is_pending_inv << 1 |
+                              log->is_key_logged << 2);
+        stream57_put_signed_varint(&w, log->step_at_key_press);
+
+        long first = get_first_new_entry(&base->log, log);
+        stream57_put_varint(&w, log->logged_count);
+        stream57_put_varint(&w, first);
+        for (long i = first; i <= log->logged_count; i++) {
+            log57_entry_t *entry = log57_get_entry(log, i);
+            stream57_put_byte(&w, entry->type);
+            stream57_put_varint(&w, entry->flags);
+            stream57_put_str(&w, entry->message, sizeof(entry->message) - 1);
+        }
+    }
+
+    if (w.overflow) return 0;
+
+    // Keep the base in sync with the receiver.
+    sync57_patch(base, buf, w.pos);
+    return w.pos;
+}
+
+bool sync57_patch(ti57_t *ti57, const unsigned char *buf, int size)
+{
+    stream57_reader_t r = {buf, size, 0, false};
+
+    if (!read_delta(ti57, &r, false)) return false;
+
+    r.pos = 0;
+    return read_delta(ti57, &r, true);
+}
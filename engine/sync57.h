@@ -0,0 +1,42 @@
+/**
+ * Mirroring the state of a TI-57 into another one, for instance in another process.
+ *
+ * The sender keeps a copy of the state of the receiver, the base. A delta holds the changes from
+ * the base to the current state:
+ * - the digits that changed in the registers, including the program steps
+ * - the program counter, the stack, the flags, the cycles, the mode and the activity
+ * - if the log changed, its state and the entries logged since the base
+ * so that its size depends on the activity since the previous delta rather than on the size of
+ * the state.
+ *
+ * Deltas should be applied in the order they were made. Caches such as the decoded steps and the
+ * display frame are not part of the deltas: they are invalidated as needed.
+ */
+
+#ifndef sync57_h
+#define sync57_h
+
+#include "ti57.h"
+
+/** The current version of the format. */
+#define SYNC57_VERSION 1
+
+/** The maximum size of a delta. */
+#define SYNC57_MAX_SIZE 24576
+
+/**
+ * Writes into 'buf' the delta from 'base' to 'ti57', and applies it to 'base'.
+ *
+ * Returns the size of the delta, or 0 if 'size' is too small.
+ */
+int sync57_diff(ti57_t *base, ti57_t *ti57, unsigned char *buf, int size);
+
+/**
+ * Applies a delta to 'ti57', which should be in the same state as the base the delta was made
+ * from.
+ *
+ * Returns false, leaving 'ti57' untouched, if the delta is invalid or was made from another base.
+ */
+bool sync57_patch(ti57_t *ti57, const unsigned char *buf, int size);
+
+#endif  /* !sync57_h */
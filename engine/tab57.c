@@ -0,0 +1,150 @@
+#include "tab57.h"
+
+#include <limits.h>
+#include <string.h>
+
+#include "fork57.h"
+#include "utils57.h"
+
+/** Runs until the calculator waits for a key event. Returns false if 'end_cycle' is reached. */
+static bool run_until_idle(ti57_t *ti57, unsigned long end_cycle)
+{
+    for (;;) {
+        long left = (long)(end_cycle - ti57->current_cycle);
+        if (left <= 0) return false;
+        if (ti57_resume(ti57, left > INT_MAX ? INT_MAX : (int)left) == TI57_YIELD_POLL) {
+            return true;
+        }
+    }
+}
+
+/** Presses and releases a key, as 'utils57_burst_until_idle' callers do, within a budget. */
+static bool press_key(ti57_t *ti57, int row, int col, unsigned long end_cycle)
+{
+    ti57_key_press(ti57, row, col);
+    if (!run_until_idle(ti57, end_cycle)) return false;
+    ti57_key_release(ti57);
+    return run_until_idle(ti57, end_cycle);
+}
+
+/**
+ * API IMPLEMENTATION
+ */
+
+void tab57_init(tab57_t *tab, const rcl57_t *rcl57, int input_reg, int output_reg,
+                unsigned long max_cycles)
+{
+    memcpy(&tab->booted, rcl57, sizeof(rcl57_t));
+    log57_detach(&tab->booted.ti57.log);
+    tab->booted.rewind = NULL;
+    tab->input_reg = input_reg;
+    tab->output_reg = output_reg;
+    tab->max_cycles = max_cycles > 0 ? max_cycles : TAB57_DEFAULT_MAX_CYCLES;
+}
+
+bool tab57_start(const tab57_t *tab, rcl57_t *rcl57, double x, tab57_result_t *result)
+{
+    ti57_t *ti57 = &rcl57->ti57;
+    ti57_reg_t input;
+
+    memset(result, 0, sizeof(tab57_result_t));
+    if (!utils57_double_to_user_reg(x, &input)) {
+        result->status = TAB57_OUT_OF_RANGE;
+        return false;
+    }
+
+    // Start from the booted state, sharing its log entries rather than copying them.
+    fork57_copy(rcl57, &tab->booted);
+    unsigned long start_cycle = ti57->current_cycle;
+    unsigned long end_cycle = start_cycle + tab->max_cycles;
+    bool is_stopped = true;
+
+    if (tab->input_reg == TAB57_X) {
+        // Exchange the input with X through T, then restore T.
+        ti57_reg_t t;
+        memcpy(t, ti57_get_regT(ti57), sizeof(ti57_reg_t));
+        memcpy(ti57_get_regT(ti57), input, sizeof(ti57_reg_t));
+        is_stopped = press_key(ti57, 2, 2, end_cycle);  // x:t
+        memcpy(ti57_get_regT(ti57), t, sizeof(ti57_reg_t));
+    } else {
+        memcpy(ti57_get_user_reg(ti57, tab->input_reg), input, sizeof(ti57_reg_t));
+    }
+    is_stopped = is_stopped && press_key(ti57, 7, 1, end_cycle);  // RST
+    result->cycle_count = ti57->current_cycle - start_cycle;
+    if (!is_stopped) {
+        result->status = TAB57_TIMEOUT;
+        return false;
+    }
+    return true;
+}
+
+bool tab57_run_to_step(const tab57_t *tab, rcl57_t *rcl57, int step, tab57_result_t *result)
+{
+    ti57_t *ti57 = &rcl57->ti57;
+    unsigned long start_cycle = ti57->current_cycle;
+    unsigned long end_cycle = start_cycle + tab->max_cycles - result->cycle_count;
+    bool is_running = false;
+
+    // R/S starts the program once released.
+    ti57_key_press(ti57, 8, 1);
+    if (run_until_idle(ti57, end_cycle)) {
+        ti57_key_release(ti57);
+        while (ti57->current_cycle < end_cycle && ti57_get_program_pc(ti57) <= step &&
+               !(ti57->mode == TI57_EVAL && (ti57->activity == TI57_POLL_PRESS ||
+                                             ti57->activity == TI57_POLL_PRESS_BLINK))) {
+            ti57_next(ti57);
+        }
+        is_running = ti57->mode == TI57_RUN && ti57_get_program_pc(ti57) > step;
+    }
+    result->cycle_count += ti57->current_cycle - start_cycle;
+    if (!is_running && ti57->current_cycle >= end_cycle) {
+        result->status = TAB57_TIMEOUT;
+    }
+    return is_running;
+}
+
+void tab57_finish(const tab57_t *tab, rcl57_t *rcl57, tab57_result_t *result)
+{
+    ti57_t *ti57 = &rcl57->ti57;
+    unsigned long start_cycle = ti57->current_cycle;
+    unsigned long end_cycle = start_cycle + tab->max_cycles - result->cycle_count;
+
+    if (result->status == TAB57_TIMEOUT) {
+        // Already out of cycles in 'tab57_run_to_step'.
+    } else if (ti57->mode == TI57_RUN ? !run_until_idle(ti57, end_cycle)
+                                      : !press_key(ti57, 8, 1, end_cycle)) {  // R/S
+        result->status = TAB57_TIMEOUT;
+    } else if (ti57_is_error(ti57)) {
+        result->status = TAB57_ERROR;
+    }
+    if (tab->output_reg == TAB57_DISPLAY) {
+        strcpy(result->output, utils57_trim(ti57_get_display(ti57)));
+        // As in 'utils57_user_reg_to_str'.
+        int length = (int)strlen(result->output);
+        if (length > 0 && result->output[length - 1] == '.') {
+            result->output[length - 1] = 0;
+        }
+    } else {
+        strcpy(result->output, utils57_user_reg_to_str(ti57_get_user_reg(ti57, tab->output_reg),
+                                                       ti57_is_sci(ti57), ti57_get_fix(ti57)));
+    }
+    result->cycle_count += ti57->current_cycle - start_cycle;
+}
+
+void tab57_eval(const tab57_t *tab, rcl57_t *rcl57, double x, tab57_result_t *result)
+{
+    if (tab57_start(tab, rcl57, x, result)) {
+        tab57_finish(tab, rcl57, result);
+    }
+}
+
+const char *tab57_status_to_str(tab57_status_t status)
+{
+    switch (status) {
+    case TAB57_OK: return "ok";
+    case TAB57_ERROR: return "error";
+    case TAB57_TIMEOUT: return "timeout";
+    case TAB57_OUT_OF_RANGE: return "out of range";
+    }
+    return "";
+}
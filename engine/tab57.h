@@ -0,0 +1,83 @@
+/**
+ * Tabulating a program: evaluating it for many inputs.
+ *
+ * Each evaluation starts from the same state, with the program loaded: the input is stored into X
+ * or into a user register, then the program is run with RST R/S until it stops, and the display
+ * or a user register is read.
+ *
+ * The state to start from is only read, so that several threads can evaluate the same 'tab57_t',
+ * each with its own 'rcl57_t' to run the evaluations in.
+ */
+
+#ifndef tab57_h
+#define tab57_h
+
+#include "rcl57.h"
+
+/** For 'input_reg': the input is stored into X, as if entered on the keyboard. */
+#define TAB57_X -1
+
+/** For 'output_reg': the output is read from the display. */
+#define TAB57_DISPLAY -1
+
+/** The default of 'max_cycles'. Around 30 minutes of an actual TI-57. */
+#define TAB57_DEFAULT_MAX_CYCLES 10000000
+
+typedef enum tab57_status_e {
+    TAB57_OK,
+    TAB57_ERROR,         // The program stopped with an error, such as a division by 0.
+    TAB57_TIMEOUT,       // The program didn't stop within 'max_cycles'.
+    TAB57_OUT_OF_RANGE,  // The input can't be stored into a TI-57 register.
+} tab57_status_t;
+
+typedef struct tab57_s {
+    rcl57_t booted;              // The state each evaluation starts from.
+    int input_reg;               // TAB57_X or a user register (0..7).
+    int output_reg;              // TAB57_DISPLAY or a user register (0..7).
+    unsigned long max_cycles;    // The longest run of the program.
+} tab57_t;
+
+typedef struct tab57_result_s {
+    tab57_status_t status;
+    char output[25];             // The trimmed display or register, even after an error.
+    unsigned long cycle_count;   // The cycles to store the input, run and stop.
+} tab57_result_t;
+
+/**
+ * Initializes 'tab' from 'rcl57', which should have the program loaded and be waiting for a key
+ * press in EVAL mode.
+ *
+ * 'max_cycles' is 0 for the default.
+ */
+void tab57_init(tab57_t *tab, const rcl57_t *rcl57, int input_reg, int output_reg,
+                unsigned long max_cycles);
+
+/** Evaluates the program for 'x', using 'rcl57' to run it, and stores the result into 'result'. */
+void tab57_eval(const tab57_t *tab, rcl57_t *rcl57, double x, tab57_result_t *result);
+
+/**
+ * The first half of 'tab57_eval': stores the input and presses RST. The state of 'rcl57' may then
+ * be copied, and its steps changed, before running the program with 'tab57_finish'.
+ *
+ * Returns false, with the status in 'result', if the program can't be run.
+ */
+bool tab57_start(const tab57_t *tab, rcl57_t *rcl57, double x, tab57_result_t *result);
+
+/**
+ * The second half of 'tab57_eval': runs the program with R/S, or on if it is already running, and
+ * reads the output.
+ */
+void tab57_finish(const tab57_t *tab, rcl57_t *rcl57, tab57_result_t *result);
+
+/**
+ * Runs the program started by 'tab57_start' with R/S until it has fetched 'step', so that the state
+ * can be examined before 'tab57_finish' runs the rest of the program.
+ *
+ * Returns false if the program stopped before, or ran out of cycles with TAB57_TIMEOUT in 'result'.
+ */
+bool tab57_run_to_step(const tab57_t *tab, rcl57_t *rcl57, int step, tab57_result_t *result);
+
+/** Returns "ok", "error", "timeout" or "out of range". */
+const char *tab57_status_to_str(tab57_status_t status);
+
+#endif  /* !tab57_h */
@@ -4,7 +4,9 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "leds57.h"
 #include "logger57.h"
+#include "memo57.h"
 #include "rom57.h"
 #include "utils57.h"
 
@@ -149,6 +151,108 @@ static ti57_address_t stack_pop(ti57_t *ti57)
     return val;
 }
 
+/**
+ * STORAGE OPERATIONS
+ *
+ * X and Y hold the user registers, the steps and other user visible state, so changes to them are
+ * tracked.
+ */
+
+/** X[RAB] = A. */
+static void store_X(ti57_t *ti57)
+{
+    unsigned char *reg = ti57->X[ti57->RAB];
+    int changes = 0;
+
+    // X[2]..X[7] hold user registers in their 14 low digits.
+    if (ti57->RAB >= 2 && memcmp(reg, ti57->A, 14) != 0) {
+        changes |= TI57_REGISTERS_CHANGE;
+    }
+    // X[0]..X[3] hold the AOS stack.
+    if (ti57->RAB <= 3 && memcmp(reg, ti57->A, 16) != 0) {
+        changes |= TI57_AOS_CHANGE;
+    }
+    // The 2 high digits hold the fix and trig modes in X[4] and the program counter and return
+    // addresses in X[5]..X[7].
+    if (ti57->RAB >= 4 && memcmp(reg + 14, ti57->A + 14, 2) != 0) {
+        if (ti57->RAB == 4) {
+            changes |= TI57_MODES_CHANGE;
+        } else {
+            // Don't invalidate the decoded steps.
+            ti57->timestamps.program += 1;
+        }
+    }
+
+    memcpy(reg, ti57->A, sizeof(ti57_reg_t));
+    if (changes) {
+        ti57_set_changed(ti57, changes);
+    }
+}
+
+/** Y[RAB] = A. */
+static void store_Y(ti57_t *ti57)
+{
+    unsigned char *reg = ti57->Y[ti57->RAB];
+    int changes = 0;
+
+    // Y[0]..Y[5] are only used for steps while Y[6] and Y[7] hold a step in their 2 high digits and
+    // a user register in their 14 low digits.
+    int lo = ti57->RAB < 6 ? 0 : 14;
+
+    if (memcmp(reg + lo, ti57->A + lo, 16 - lo) != 0) {
+        changes |= TI57_PROGRAM_CHANGE;
+    }
+    if (ti57->RAB >= 6 && memcmp(reg, ti57->A, 14) != 0) {
+        changes |= TI57_REGISTERS_CHANGE;
+    }
+
+    memcpy(reg, ti57->A, sizeof(ti57_reg_t));
+    if (changes) {
+        ti57_set_changed(ti57, changes);
+    }
+}
+
+/** Builds the frame from dA and dB, the same way 'utils57_display_to_str' builds the string. */
+static void update_frame(ti57_t *ti57)
+{
+    static char DIGITS[] = "0123456789AbCdEF";
+
+    for (int i = 11; i >= 0; i--) {
+        unsigned char mask = ti57->dB[i];
+        int segments;
+
+        if (mask & 0x8) {
+            segments = leds57_get_segments(' ');
+        } else if (mask & 0x1) {
+            segments = leds57_get_segments('-');
+        } else {
+            segments = leds57_get_segments(DIGITS[ti57->dA[i]]);
+        }
+        if (mask & 0x2) {
+            segments |= LEDS57_DOT;
+        }
+        ti57->frame.leds[11 - i] = segments;
+    }
+    ti57->frame.timestamp = ti57->timestamps.display;
+}
+
+/** Latches A and B for display purposes. */
+static void store_display(ti57_t *ti57)
+{
+    // Only the 12 low digits are displayed.
+    bool changed = memcmp(ti57->dA, ti57->A, 12) != 0 || memcmp(ti57->dB, ti57->B, 12) != 0;
+
+    memcpy(ti57->dA, ti57->A, sizeof(ti57_reg_t));
+    memcpy(ti57->dB, ti57->B, sizeof(ti57_reg_t));
+    ti57->is_display_pending = false;
+
+    // Also build the frame the first time around.
+    if (changed || ti57->frame.timestamp == 0) {
+        ti57->timestamps.display += 1;
+        update_frame(ti57);
+    }
+}
+
 /**
  * CPU OPERATIONS
  */
@@ -204,15 +308,20 @@ static void op_misc(ti57_t *ti57, ti57_opcode_t opcode)
     case 3: ti57->COND = 0;
             ti57->pc = stack_pop(ti57);
             break;
-    case 4: memcpy(ti57->X[ti57->RAB], ti57->A, sizeof(ti57_reg_t)); break;
+    case 4: store_X(ti57); break;
     case 5: memcpy(ti57->A, ti57->X[ti57->RAB], sizeof(ti57_reg_t)); break;
-    case 6: memcpy(ti57->Y[ti57->RAB], ti57->A, sizeof(ti57_reg_t)); break;
+    case 6: store_Y(ti57); break;
     case 7: if (ti57->is_key_pressed) {
                 ti57->R5 = ti57->col << 4 | (ti57->row - 1);
                 ti57->COND = 1;
             }
-            memcpy(ti57->dA, ti57->A, sizeof(ti57_reg_t));
-            memcpy(ti57->dB, ti57->B, sizeof(ti57_reg_t));
+            if (ti57->is_lazy_display &&
+                ti57->mode == TI57_RUN && ti57->activity != TI57_PAUSE) {
+                // Latch later, only if needed.
+                ti57->is_display_pending = true;
+            } else {
+                store_display(ti57);
+            }
             ti57->last_disp_cycle = ti57->current_cycle;
             break;
     case 8: ti57->is_hex = false; break;
@@ -311,6 +420,26 @@ static void op_mask(ti57_t *ti57, ti57_opcode_t opcode) {
  * STATE UPDATE
  */
 
+/** Whether a given operation may modify A or B. */
+static bool may_modify_AB(ti57_opcode_t opcode)
+{
+    if ((opcode & 0x1800) == 0x1800 || (opcode & 0x1800) == 0x1000) {
+        // Branch or call.
+        return false;
+    } else if ((opcode & 0x1f00) == 0x0e00) {
+        // Misc operation: A = Y[RAB] or A = X[RAB].
+        int p = opcode & 0x000f;
+        return p == 0 || p == 5;
+    } else if ((opcode & 0x1f00) == 0x0c00) {
+        // Flag operation, other than a test, on A or B.
+        int j = (opcode & 0x00c0) >> 6;
+        int f = opcode & 0x0003;
+        return j <= 1 && f != 2;
+    }
+    // Mask operation.
+    return true;
+}
+
 static void update_mode(ti57_t *ti57)
 {
     if ((ti57->C[15] & 0x1) != 0) {
@@ -323,6 +452,26 @@ static void update_mode(ti57_t *ti57)
     }
 }
 
+/**
+ * Keeps track of changes to the flags, the mode and the AOS stack, which are held in the high digits
+ * of the operational registers.
+ *
+ * Note: this function should be called after every operation that may modify B, C or D.
+ */
+static void update_status(ti57_t *ti57)
+{
+    unsigned short status = ti57->B[15] | ti57->C[14] << 4 | ti57->C[15] << 8 | ti57->D[15] << 12;
+    unsigned short diff = status ^ ti57->status;
+
+    if (diff == 0) return;
+
+    // B[15], C[14] and C[15] hold the flags and the mode.
+    if (diff & 0x0fff) ti57->timestamps.modes += 1;
+    // D[15] holds the number of operands, B[15] and C[14] whether there is a last operand.
+    if (diff & 0xf021) ti57->timestamps.aos += 1;
+    ti57->status = status;
+}
+
 static bool is_pc_in(ti57_t *ti57, int lo, int hi, int depth)
 {
    if (ti57->pc >= lo && ti57->pc <= hi) return true;
@@ -335,6 +484,21 @@ static bool is_pc_in(ti57_t *ti57, int lo, int hi, int depth)
    return false;
 }
 
+/** Whether the calculator is waiting for a key event that hasn't happened yet. */
+static bool is_idle(ti57_t *ti57)
+{
+    switch (ti57->activity) {
+    case TI57_POLL_PRESS:
+    case TI57_POLL_PRESS_BLINK:
+        return !ti57->is_key_pressed;
+    case TI57_POLL_RELEASE:
+    case TI57_POLL_RS_RELEASE:
+        return ti57->is_key_pressed;
+    default:
+        return false;
+    }
+}
+
 static void update_activity(ti57_t *ti57)
 {
     if (ti57->stack[0] == 0x010a || ti57->stack[1] == 0x010a) {
@@ -351,6 +515,110 @@ static void update_activity(ti57_t *ti57)
     }
 }
 
+/**
+ * MEMOIZATION
+ */
+
+/** The longest a pure subroutine may run before giving up on caching it. */
+#define MAX_ROUTINE_CYCLES 20000
+
+static void get_regs(ti57_t *ti57, memo57_regs_t *regs)
+{
+    // Clear the padding, if any, since the entries are compared with 'memcmp'.
+    memset(regs, 0, sizeof(memo57_regs_t));
+    memcpy(regs->A, ti57->A, sizeof(ti57_reg_t));
+    memcpy(regs->B, ti57->B, sizeof(ti57_reg_t));
+    memcpy(regs->C, ti57->C, sizeof(ti57_reg_t));
+    memcpy(regs->D, ti57->D, sizeof(ti57_reg_t));
+    regs->pc = ti57->pc;
+    memcpy(regs->stack, ti57->stack, sizeof(ti57->stack));
+    regs->RAB = ti57->RAB;
+    regs->R5 = ti57->R5;
+    regs->COND = ti57->COND;
+    regs->is_hex = ti57->is_hex;
+}
+
+static void set_regs(ti57_t *ti57, const memo57_regs_t *regs)
+{
+    memcpy(ti57->A, regs->A, sizeof(ti57_reg_t));
+    memcpy(ti57->B, regs->B, sizeof(ti57_reg_t));
+    memcpy(ti57->C, regs->C, sizeof(ti57_reg_t));
+    memcpy(ti57->D, regs->D, sizeof(ti57_reg_t));
+    ti57->pc = regs->pc;
+    memcpy(ti57->stack, regs->stack, sizeof(ti57->stack));
+    ti57->RAB = regs->RAB;
+    ti57->R5 = regs->R5;
+    ti57->COND = regs->COND;
+    ti57->is_hex = regs->is_hex;
+}
+
+/**
+ * Runs the subroutine just called, with inputs 'in', until it returns, and caches its outputs
+ * unless the mode or the activity changed. Returns the cycles it took.
+ */
+static int run_routine(ti57_t *ti57, const memo57_regs_t *in)
+{
+    unsigned long start_cycle = ti57->current_cycle;
+    ti57_mode_t mode = ti57->mode;
+    int depth = 0;
+
+    while (ti57->current_cycle - start_cycle < MAX_ROUTINE_CYCLES) {
+        ti57_address_t pc = ti57->pc;
+        ti57_opcode_t opcode = ROM57[pc];
+
+        // Leave the operations that aren't pure to the caller.
+        if (!memo57_is_pure_op(opcode)) break;
+
+        ti57_next(ti57);
+        if (ti57->mode != mode || ti57->activity != TI57_BUSY) break;
+        if ((opcode & 0x1800) == 0x1000) {
+            // A call, unless the subroutine called has been run or reused by 'ti57_next'.
+            if (ti57->pc != pc + 1) depth += 1;
+        } else if ((opcode & 0x1f0f) == 0x0e03 && depth-- == 0) {
+            memo57_regs_t out;
+            get_regs(ti57, &out);
+            memo57_add(ti57->memo, in, &out, ti57->current_cycle - start_cycle);
+            break;
+        }
+    }
+    return ti57->current_cycle - start_cycle;
+}
+
+/**
+ * Runs the pure subroutine just called, or reuses its outputs if cached. Returns the cycles it
+ * took.
+ */
+static int call_routine(ti57_t *ti57)
+{
+    memo57_t *memo = ti57->memo;
+    memo57_regs_t in;
+    unsigned long cycle_count;
+
+    get_regs(ti57, &in);
+    const memo57_regs_t *out = memo57_find(memo, &in, &cycle_count);
+    if (out == NULL) return run_routine(ti57, &in);
+
+    if (memo->is_verifying) {
+        memo57_regs_t expected = *out, actual;
+        int n = run_routine(ti57, &in);
+        get_regs(ti57, &actual);
+        if (n != (int)cycle_count || memcmp(&actual, &expected, sizeof(memo57_regs_t)) != 0) {
+            memo->mismatch_count += 1;
+        }
+        return n;
+    }
+
+    // The mode and the activity are those of the run that has been cached.
+    set_regs(ti57, out);
+    update_status(ti57);
+    ti57->current_cycle += cycle_count;
+    if (ti57->mode == TI57_EVAL) {
+        // As set by 'update_mode' for the last operation, the return.
+        ti57->last_eval_cycle = ti57->current_cycle - 1;
+    }
+    return cycle_count;
+}
+
 /**
  *  API IMPLEMENTATION
  */
@@ -368,6 +636,11 @@ int ti57_next(ti57_t *ti57)
 
     assert(opcode <= 0x1fff);
 
+    // Latch a deferred display before A or B change.
+    if (ti57->is_display_pending && may_modify_AB(opcode)) {
+        store_display(ti57);
+    }
+
     ti57->pc += 1;
 
     // Execute operation.
@@ -379,20 +652,58 @@ int ti57_next(ti57_t *ti57)
         op_misc(ti57, opcode);
     } else if ((opcode & 0x1f00) == 0x0c00) {
         op_flag(ti57, opcode);
+        update_status(ti57);
     } else if ((opcode & 0x1000) == 0x0000) {
         op_mask(ti57, opcode);
+        update_status(ti57);
     }
 
     // Update state.
     update_mode(ti57);
     update_activity(ti57);
+    if (ti57->activity != previous_activity) {
+        ti57->timestamps.modes += 1;
+    }
+    if (ti57->is_display_pending &&
+        (ti57->mode != previous_mode || ti57->activity != previous_activity)) {
+        store_display(ti57);
+    }
     logger57_update_after_next(ti57, previous_activity, previous_mode);
 
     int cost = ((opcode & 0x0e07) == 0x0e07) ? 32 : 1;
     ti57->current_cycle += cost;
+
+    // Run a pure subroutine at once, so that it can be cached. Most instructions are not calls:
+    // test the opcode first.
+    if ((opcode & 0x1800) == 0x1000 && ti57->memo && ti57->memo->is_enabled[ti57->pc] &&
+        ti57->activity == TI57_BUSY && !ti57->is_display_pending) {
+        cost += call_routine(ti57);
+    }
     return cost;
 }
 
+ti57_yield_t ti57_resume(ti57_t *ti57, int budget)
+{
+    unsigned long end_cycle = ti57->current_cycle + budget;
+
+    while ((long)(end_cycle - ti57->current_cycle) > 0) {
+        ti57_mode_t previous_mode = ti57->mode;
+        ti57_activity_t previous_activity = ti57->activity;
+        bool was_idle = is_idle(ti57);
+        long display_timestamp = ti57->timestamps.display;
+
+        ti57_next(ti57);
+
+        if (ti57->mode != previous_mode) return TI57_YIELD_MODE;
+        if (ti57->activity == TI57_PAUSE && previous_activity != TI57_PAUSE) {
+            return TI57_YIELD_PAUSE;
+        }
+        if (!was_idle && is_idle(ti57)) return TI57_YIELD_POLL;
+        if (ti57->timestamps.display != display_timestamp) return TI57_YIELD_DISPLAY;
+    }
+    return TI57_YIELD_BUDGET;
+}
+
 void ti57_key_release(ti57_t *ti57)
 {
     // Do not zero out row and col, so we can keep track of the last pressed key.
@@ -409,12 +720,16 @@ void ti57_key_press(ti57_t *ti57, int row, int col)
     ti57->col = col;
     ti57->is_key_pressed = true;
     ti57->log.step_at_key_press = ti57_get_program_pc(ti57);
+
+    // Some flags, such as '2nd', depend on the last pressed key.
+    ti57->timestamps.modes += 1;
 }
 
 char *ti57_get_display(ti57_t *ti57)
 {
-    static char str[26];
+    static _Thread_local char str[26];
 
+    ti57_flush_display(ti57);
     if (ti57->current_cycle - ti57->last_disp_cycle > 50) {
         strcpy(str, "            ");
         return str;
@@ -422,3 +737,22 @@ char *ti57_get_display(ti57_t *ti57)
 
     return utils57_display_to_str(&ti57->dA, &ti57->dB);
 }
+
+ti57_frame_t *ti57_get_display_frame(ti57_t *ti57)
+{
+    ti57_flush_display(ti57);
+
+    // The frame may not have been built yet, for instance after restoring a saved state.
+    if (ti57->frame.timestamp == 0) {
+        ti57->timestamps.display += 1;
+        update_frame(ti57);
+    }
+    return &ti57->frame;
+}
+
+void ti57_flush_display(ti57_t *ti57)
+{
+    if (ti57->is_display_pending) {
+        store_display(ti57);
+    }
+}
@@ -34,9 +34,36 @@ void ti57_init(ti57_t *ti57);
  *
  * Returns the relative cost of the operation, most often 1 though some
  * operations, such as those involving the display, may take longer.
+ *
+ * With a cache attached to 'memo' (see memo57.h), a call to a pure subroutine
+ * also runs or reuses the subroutine, and its cost is included.
  */
 int ti57_next(ti57_t *ti57);
 
+/** Why 'ti57_resume' returned. */
+typedef enum ti57_yield_e {
+    TI57_YIELD_BUDGET,   // The budget has been used up.
+    TI57_YIELD_DISPLAY,  // The display has been latched with different digits.
+    TI57_YIELD_POLL,     // The calculator has started waiting for a key event that hasn't happened.
+    TI57_YIELD_PAUSE,    // 'Pause' has started.
+    TI57_YIELD_MODE,     // The mode (EVAL, LRN, RUN) has changed.
+} ti57_yield_t;
+
+/**
+ * Executes operations until at least 'budget' cycles have elapsed, or until one of the events in
+ * 'ti57_yield_t' happens.
+ *
+ * This lets a single thread interleave many calculators: each call returns at a point where the
+ * host may want to act, and the next call resumes from there. If several events happen in the
+ * same operation, the last one in 'ti57_yield_t' is returned. The number of cycles executed can be
+ * found from 'current_cycle'.
+ *
+ * For instance, an event loop may resume each calculator with a small budget, repaint it on
+ * TI57_YIELD_DISPLAY and stop resuming it on TI57_YIELD_POLL until the next key event. Note that
+ * the display may still blink while polling.
+ */
+ti57_yield_t ti57_resume(ti57_t *ti57, int budget);
+
 /** Should be called when a key is pressed (row in 1..8, col in 1..5). */
 void ti57_key_press(ti57_t *ti57, int row, int col);
 
@@ -58,4 +85,24 @@ void ti57_key_release(ti57_t *ti57);
  */
 char *ti57_get_display(ti57_t *ti57);
 
+/**
+ * Returns the display as a frame of segments.
+ *
+ * The frame is built by the emulator when the display actually changes. Clients can keep the
+ * timestamp of the frame they have rendered, and repaint only when it differs.
+ *
+ * Note that, unlike 'ti57_get_display', the frame is not blanked when the display hasn't been
+ * refreshed for a while.
+ */
+ti57_frame_t *ti57_get_display_frame(ti57_t *ti57);
+
+/**
+ * Latches the display if this has been deferred.
+ *
+ * If 'is_lazy_display' is set, in RUN mode, A and B are only latched into dA and dB when they are
+ * about to change, when the mode or the activity changes, or when the display is read. Clients that
+ * read dA or dB directly should call this function first.
+ */
+void ti57_flush_display(ti57_t *ti57);
+
 #endif  /* !ti57_h */
@@ -1,5 +1,8 @@
 #include "utils57.h"
 
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 char *utils57_trim(char *str)
@@ -21,7 +24,7 @@ char *utils57_trim(char *str)
 
 char *utils57_reg_to_str(ti57_reg_t reg)
 {
-    static char str[17];
+    static _Thread_local char str[17];
     static char digits[] = "0123456789ABCDEF";
 
     for (int i = 0; i < 16; i++) {
@@ -35,7 +38,7 @@ char *utils57_user_reg_to_str(ti57_reg_t *reg, bool sci, int fix)
 {
     // Hack: we run a new emulator and modify its state to compute the string representation of reg.
 
-    static char str[25];
+    static _Thread_local char str[25];
     ti57_t ti57;
     ti57_reg_t *T;
 
@@ -69,10 +72,37 @@ char *utils57_user_reg_to_str(ti57_reg_t *reg, bool sci, int fix)
     return str;
 }
 
+bool utils57_double_to_user_reg(double x, ti57_reg_t *reg)
+{
+    char str[32];
+
+    if (!isfinite(x)) return false;
+    if (x == 0) {
+        memset(reg, 0, sizeof(ti57_reg_t));
+        return true;
+    }
+
+    // "d.dddddddddde+XX", which also rounds the mantissa.
+    snprintf(str, sizeof(str), "%.10e", fabs(x));
+    int exponent = atoi(str + 13);
+    if (exponent < -99 || exponent > 99) return false;
+
+    // The mantissa is in digits 12..2, the flags in digit 13 and the exponent in digits 1..0.
+    memset(reg, 0, sizeof(ti57_reg_t));
+    (*reg)[12] = str[0] - '0';
+    for (int i = 0; i < 10; i++) {
+        (*reg)[11 - i] = str[2 + i] - '0';
+    }
+    (*reg)[13] = (x < 0 ? 0x1 : 0) | (exponent < 0 ? 0x2 : 0);
+    (*reg)[1] = abs(exponent) / 10;
+    (*reg)[0] = abs(exponent) % 10;
+    return true;
+}
+
 char *utils57_display_to_str(ti57_reg_t *digits, ti57_reg_t *mask)
 {
     static char DIGITS[] = "0123456789AbCdEF";
-    static char str[25];
+    static _Thread_local char str[25];
     int k = 0;
 
     // Go through the 12 digits.
@@ -124,3 +154,17 @@ void utils57_burst_until_busy(ti57_t *ti57)
         ti57_next(ti57);
     }
 }
+
+unsigned long utils57_crc32(unsigned long crc, const void *data, int size)
+{
+    const unsigned char *bytes = data;
+
+    crc = ~crc & 0xffffffff;
+    for (int i = 0; i < size; i++) {
+        crc ^= bytes[i];
+        for (int j = 0; j < 8; j++) {
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+        }
+    }
+    return ~crc & 0xffffffff;
+}
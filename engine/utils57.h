@@ -22,6 +22,14 @@ char *utils57_reg_to_str(ti57_reg_t reg);
  */
 char *utils57_user_reg_to_str(ti57_reg_t *reg, bool sci, int fix);
 
+/**
+ * Stores 'x' into the user register at 'reg', rounded to 11 significant digits.
+ *
+ * Returns false, leaving 'reg' untouched, if 'x' is not finite or is out of the range of a
+ * TI-57 (1e-99 to 9.9999999999e99 in absolute value, or 0).
+ */
+bool utils57_double_to_user_reg(double x, ti57_reg_t *reg);
+
 /**
  * Given 2 registers, one representing the display digits (typically registers A or dA in ti57_t) and the
  * other one the mask (typically register B or dB in ti57_t),  returns a string representing the display.
@@ -34,4 +42,9 @@ void utils57_burst_until_idle(ti57_t *ti57);
 /** Calls 'ti57_next' repeatedly until the calculator is in a busy state. */
 void utils57_burst_until_busy(ti57_t *ti57);
 
+/**
+ * Updates the CRC-32 (IEEE 802.3) 'crc' with 'size' bytes of 'data'. Use 0 as the initial value.
+ */
+unsigned long utils57_crc32(unsigned long crc, const void *data, int size);
+
 #endif  /* !utils57_h */
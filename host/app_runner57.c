@@ -0,0 +1,218 @@
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "runner57.h"
+
+// The keys of a program that loops forever: LRN, Lbl 1, GTO 1, LRN, RST, R/S.
+static const int PROGRAM_KEYS[] = {21, 11, 81, 72, 51, 72, 21, 71, 81};
+
+// The time between a change of the display and the next key, as when typing fast.
+#define KEY_PERIOD_US 100000
+
+// The longest wait for a key to change the display.
+#define KEY_TIMEOUT_NS 1000000000LL
+
+static atomic_bool is_stopping;
+
+static long long get_time_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void sleep_us(long us)
+{
+    struct timespec ts = {us / 1000000, us % 1000000 * 1000};
+    nanosleep(&ts, NULL);
+}
+
+/** Keeps a CPU busy, to load the host. */
+static void *spin(void *arg)
+{
+    (void)arg;
+    volatile unsigned long count = 0;
+    while (!atomic_load_explicit(&is_stopping, memory_order_relaxed)) {
+        count++;
+    }
+    return NULL;
+}
+
+static int compare_long_long(const void *p1, const void *p2)
+{
+    long long n1 = *(const long long *)p1, n2 = *(const long long *)p2;
+    return (n1 > n2) - (n1 < n2);
+}
+
+/** Sorts the samples and prints their distribution, in ms. */
+static void print_samples(const char *name, long long *samples, int count)
+{
+    long long sum = 0;
+
+    if (count == 0) {
+        printf("%s: no samples\n", name);
+        return;
+    }
+    qsort(samples, count, sizeof(samples[0]), compare_long_long);
+    for (int i = 0; i < count; i++) {
+        sum += samples[i];
+    }
+    printf("%s: %d samples, mean %.3f ms, p50 %.3f ms, p99 %.3f ms, max %.3f ms\n", name, count,
+           sum / 1e6 / count, samples[count / 2] / 1e6, samples[count * 99 / 100] / 1e6,
+           samples[count - 1] / 1e6);
+}
+
+/**
+ * Types 'count' keys, alternating 1 and CLR so that each key changes the display, and measures the
+ * time from each key press to the first frame with the new display.
+ */
+static int measure_keys(runner57_t *runner, long long *latencies, int count)
+{
+    runner57_frame_t frame;
+    int sample_count = 0;
+
+    for (int i = 0; i < count; i++) {
+        char display[sizeof(frame.display)];
+        runner57_read_frame(runner, &frame);
+        strcpy(display, frame.display);
+
+        long long press_ns = get_time_ns();
+        if (i % 2 == 0) {
+            runner57_key_press(runner, 7, 2);
+        } else {
+            runner57_key_press(runner, 1, 5);
+        }
+        runner57_key_release(runner);
+
+        // The frames published meanwhile replace each other: poll often enough to see the first
+        // one with the new display.
+        while (get_time_ns() - press_ns < KEY_TIMEOUT_NS) {
+            runner57_read_frame(runner, &frame);
+            if (frame.key_time_ns >= press_ns && strcmp(frame.display, display) != 0) {
+                latencies[sample_count++] = frame.time_ns - press_ns;
+                break;
+            }
+            sleep_us(20);
+        }
+        sleep_us(KEY_PERIOD_US);
+    }
+    return sample_count;
+}
+
+/** Types the keys of a program that loops forever, and starts it. */
+static void start_program(runner57_t *runner)
+{
+    for (int i = 0; i < (int)(sizeof(PROGRAM_KEYS) / sizeof(PROGRAM_KEYS[0])); i++) {
+        runner57_key_press(runner, PROGRAM_KEYS[i] / 10, PROGRAM_KEYS[i] % 10);
+        sleep_us(100000);
+        runner57_key_release(runner);
+        sleep_us(300000);
+    }
+}
+
+/** Records the intervals between the frames published during 'seconds'. */
+static int measure_frames(runner57_t *runner, long long *intervals, int max_count, double seconds)
+{
+    runner57_frame_t frame;
+    long long end_ns = get_time_ns() + (long long)(seconds * 1e9);
+    int count = 0;
+
+    runner57_read_frame(runner, &frame);
+    long long last_ns = frame.time_ns;
+    while (get_time_ns() < end_ns && count < max_count) {
+        runner57_read_frame(runner, &frame);
+        if (frame.time_ns != last_ns) {
+            intervals[count++] = frame.time_ns - last_ns;
+            last_ns = frame.time_ns;
+        }
+        sleep_us(100);
+    }
+    return count;
+}
+
+static int usage(char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-l THREADS] [-k KEYS] [-p PERIOD_MS] [-d SECONDS]\n"
+            "Measures the key to display latency of KEYS keys, then the intervals between the\n"
+            "frames of a running program for SECONDS, while THREADS threads keep the CPUs busy.\n",
+            name);
+    return 2;
+}
+
+int main(int argc, char **argv)
+{
+    int thread_count = 4, key_count = 100, busy_period_ms = 0;
+    double seconds = 5;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "l:k:p:d:")) != -1) {
+        switch (opt) {
+        case 'l': thread_count = atoi(optarg); break;
+        case 'k': key_count = atoi(optarg); break;
+        case 'p': busy_period_ms = atoi(optarg); break;
+        case 'd': seconds = atof(optarg); break;
+        default: return usage(argv[0]);
+        }
+    }
+    if (optind != argc || thread_count < 0 || key_count < 0 || busy_period_ms < 0 ||
+        seconds <= 0) {
+        return usage(argv[0]);
+    }
+
+    static rcl57_t rcl57;
+    static runner57_t runner;
+    rcl57_init(&rcl57);
+    if (!runner57_start(&runner, &rcl57, busy_period_ms)) {
+        fprintf(stderr, "can't start the runner\n");
+        return 1;
+    }
+    sleep_us(500000);
+
+    pthread_t *threads = calloc(thread_count, sizeof(pthread_t));
+    for (int i = 0; i < thread_count; i++) {
+        pthread_create(&threads[i], NULL, spin, NULL);
+    }
+
+    long long *latencies = calloc(key_count, sizeof(long long));
+    int latency_count = measure_keys(&runner, latencies, key_count);
+    if (latency_count < key_count) {
+        printf("%d keys didn't change the display\n", key_count - latency_count);
+    }
+    print_samples("key to display", latencies, latency_count);
+
+    start_program(&runner);
+    runner57_frame_t frame;
+    runner57_read_frame(&runner, &frame);
+    if (frame.mode != TI57_RUN || frame.activity != TI57_BUSY) {
+        fprintf(stderr, "the program is not running\n");
+    }
+    int max_interval_count = (int)(seconds * 10000);
+    long long *intervals = calloc(max_interval_count, sizeof(long long));
+    int interval_count = measure_frames(&runner, intervals, max_interval_count, seconds);
+
+    // The jitter is the distance to the period of the runner.
+    long long period_ns = runner.busy_period_ms * 1000000LL;
+    long long *jitters = calloc(interval_count + 1, sizeof(long long));
+    for (int i = 0; i < interval_count; i++) {
+        jitters[i] = llabs(intervals[i] - period_ns);
+    }
+    print_samples("frame interval", intervals, interval_count);
+    print_samples("frame jitter", jitters, interval_count);
+
+    atomic_store(&is_stopping, true);
+    for (int i = 0; i < thread_count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    runner57_stop(&runner);
+    free(jitters);
+    free(intervals);
+    free(latencies);
+    free(threads);
+    return 0;
+}
@@ -0,0 +1,256 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "arena57.h"
+#include "sched57.h"
+
+// The keys of a program that loops forever: LRN, Lbl 1, GTO 1, LRN, RST, R/S.
+static const int PROGRAM_KEYS[] = {21, 11, 81, 72, 51, 72, 21, 71, 81};
+
+// The time between 2 bursts of keys of a typing session.
+#define TYPING_PERIOD_MS 200
+
+/** What the tool follows of a session, in 'user'. */
+typedef struct session_info_s {
+    unsigned long last_cycle;      // The cycle at the end of the previous slice.
+    atomic_ulong max_slice_cycles;
+} session_info_t;
+
+static double get_time(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** Records the emulated cycles of each slice. Called by the workers. */
+static void on_slice(sched57_session_t *session)
+{
+    session_info_t *info = session->user;
+    unsigned long cycle = session->rcl57->ti57.current_cycle;
+    unsigned long cycles = cycle - info->last_cycle;
+
+    info->last_cycle = cycle;
+    if (cycles > atomic_load(&info->max_slice_cycles)) {
+        atomic_store(&info->max_slice_cycles, cycles);
+    }
+}
+
+static void type_key(rcl57_t *rcl57, int key)
+{
+    rcl57_key_press(rcl57, key / 10, key % 10);
+    rcl57_advance(rcl57, 100);
+    rcl57_key_release(rcl57);
+    rcl57_advance(rcl57, 300);
+}
+
+static sched57_session_t *add(sched57_t *sched, rcl57_t *rcl57, session_info_t *info)
+{
+    info->last_cycle = rcl57->ti57.current_cycle;
+    atomic_store(&info->max_slice_cycles, 0);
+    sched57_session_t *session = sched57_add(sched, rcl57, info);
+    if (session == NULL) {
+        fprintf(stderr, "can't add a session\n");
+        exit(1);
+    }
+    return session;
+}
+
+typedef struct typing_s {
+    sched57_session_t **sessions;
+    int count;
+    int burst;                     // The keys typed at once.
+    atomic_bool is_stopping;
+} typing_t;
+
+/** Types 'burst' digits into each typing session every TYPING_PERIOD_MS, spread over the period. */
+static void *type(void *arg)
+{
+    typing_t *typing = arg;
+
+    for (long tick = 0; !atomic_load(&typing->is_stopping); tick++) {
+        for (int i = (int)(tick % 10); i < typing->count; i += 10) {
+            for (int k = 0; k < typing->burst; k++) {
+                sched57_key_press(typing->sessions[i], 7, 2 + k % 3);
+                sched57_key_release(typing->sessions[i]);
+            }
+        }
+        usleep(TYPING_PERIOD_MS * 1000 / 10);
+    }
+    return NULL;
+}
+
+/** Adds up the accounting of some sessions, and prints it with the CPU usage. */
+static void print_stats(const char *name, sched57_session_t **sessions, int count,
+                        double seconds, double cpu_seconds)
+{
+    sched57_stats_t total = {0};
+    long long max_wait_ns = 0, max_key_latency_ns = 0;
+    unsigned long max_slice_cycles = 0;
+
+    for (int i = 0; i < count; i++) {
+        sched57_stats_t stats;
+        session_info_t *info = sessions[i]->user;
+        sched57_get_stats(sessions[i], &stats);
+        total.slice_count += stats.slice_count;
+        total.wait_ns += stats.wait_ns;
+        total.key_count += stats.key_count;
+        total.key_latency_ns += stats.key_latency_ns;
+        if (stats.max_wait_ns > max_wait_ns) max_wait_ns = stats.max_wait_ns;
+        if (stats.max_key_latency_ns > max_key_latency_ns) {
+            max_key_latency_ns = stats.max_key_latency_ns;
+        }
+        if (atomic_load(&info->max_slice_cycles) > max_slice_cycles) {
+            max_slice_cycles = atomic_load(&info->max_slice_cycles);
+        }
+    }
+
+    unsigned int speedup = count > 0 ? sessions[0]->rcl57->speedup : 1;
+    printf("%s: %d sessions, %.1f%% CPU, %ld slices", name, count,
+           100 * cpu_seconds / seconds, total.slice_count);
+    if (total.slice_count > 0) {
+        printf(", mean wait %.2f ms, max %.2f ms", total.wait_ns / 1e6 / total.slice_count,
+               max_wait_ns / 1e6);
+        printf(", max %.0f ms emulated per slice", max_slice_cycles / (5.0 * speedup));
+    }
+    if (total.key_count > 0) {
+        printf(", mean key latency %.2f ms, max %.2f ms",
+               total.key_latency_ns / 1e6 / total.key_count, max_key_latency_ns / 1e6);
+    }
+    printf("\n");
+}
+
+/** Runs for 'seconds' and returns the CPU time used by the process meanwhile. */
+static double measure(double seconds)
+{
+    double start_cpu = get_time(CLOCK_PROCESS_CPUTIME_ID);
+
+    usleep((useconds_t)(seconds * 1e6));
+    return get_time(CLOCK_PROCESS_CPUTIME_ID) - start_cpu;
+}
+
+/**
+ * Adds and removes sessions while they process keys, to check the removal of queued and running
+ * sessions, for example when built with -fsanitize=thread.
+ */
+static void churn(sched57_t *sched, rcl57_t **calcs, session_info_t *infos, int count, int rounds)
+{
+    sched57_session_t *sessions[64];
+
+    if (count > 64) count = 64;
+    for (int round = 0; round < rounds; round++) {
+        for (int i = 0; i < count; i++) {
+            sessions[i] = add(sched, calcs[i], &infos[i]);
+            sched57_key_press(sessions[i], 8, 1);
+            sched57_key_release(sessions[i]);
+        }
+        usleep(500);
+        for (int i = 0; i < count; i++) {
+            sched57_remove(sessions[i]);
+        }
+    }
+}
+
+static int usage(char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-w WORKERS] [-p PARKED] [-b BUSY] [-t TYPING] [-k KEYS] [-d SECONDS]\n"
+            "          [-r ROUNDS]\n"
+            "Measures the CPU usage of PARKED idle sessions, then the waits, key latencies and\n"
+            "slice lengths once BUSY of them run a program and TYPING of them get bursts of KEYS\n"
+            "keys, then adds and removes sessions for ROUNDS rounds.\n", name);
+    return 2;
+}
+
+int main(int argc, char **argv)
+{
+    sched57_config_t config = {4, 0, 0, 0, on_slice};
+    int parked_count = 20000, busy_count = 1000, typing_count = 200, burst = 4, rounds = 100;
+    double seconds = 5;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "w:p:b:t:k:d:r:")) != -1) {
+        switch (opt) {
+        case 'w': config.worker_count = atoi(optarg); break;
+        case 'p': parked_count = atoi(optarg); break;
+        case 'b': busy_count = atoi(optarg); break;
+        case 't': typing_count = atoi(optarg); break;
+        case 'k': burst = atoi(optarg); break;
+        case 'd': seconds = atof(optarg); break;
+        case 'r': rounds = atoi(optarg); break;
+        default: return usage(argv[0]);
+        }
+    }
+    if (optind != argc || parked_count <= 0 || busy_count < 0 || typing_count < 0 || burst < 0 ||
+        busy_count + typing_count > parked_count || seconds <= 0 || rounds < 0) {
+        return usage(argv[0]);
+    }
+    config.max_session_count = parked_count;
+
+    arena57_t arena;
+    rcl57_t **calcs = calloc(parked_count, sizeof(rcl57_t *));
+    session_info_t *infos = calloc(parked_count, sizeof(session_info_t));
+    sched57_session_t **sessions = calloc(parked_count, sizeof(sched57_session_t *));
+    if (!arena57_init(&arena, parked_count) || !calcs || !infos || !sessions) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    // Idle calculators, and a running program to copy into the busy ones.
+    static rcl57_t idle, running;
+    rcl57_init(&idle);
+    rcl57_advance(&idle, 500);
+    running = idle;
+    for (int i = 0; i < (int)(sizeof(PROGRAM_KEYS) / sizeof(PROGRAM_KEYS[0])); i++) {
+        type_key(&running, PROGRAM_KEYS[i]);
+    }
+    for (int i = 0; i < parked_count; i++) {
+        calcs[i] = arena57_alloc(&arena);
+        *calcs[i] = idle;
+    }
+
+    sched57_t sched;
+    if (!sched57_start(&sched, &config)) {
+        fprintf(stderr, "can't start the scheduler\n");
+        return 1;
+    }
+
+    for (int i = 0; i < parked_count; i++) {
+        sessions[i] = add(&sched, calcs[i], &infos[i]);
+    }
+    usleep(200000);
+    print_stats("parked", sessions, parked_count, seconds, measure(seconds));
+
+    // Sessions 0.. run the program, the next ones type.
+    for (int i = 0; i < busy_count; i++) {
+        sched57_remove(sessions[i]);
+        *calcs[i] = running;
+        sessions[i] = add(&sched, calcs[i], &infos[i]);
+    }
+    typing_t typing = {sessions + busy_count, typing_count, burst, false};
+    pthread_t typing_thread;
+    pthread_create(&typing_thread, NULL, type, &typing);
+    double cpu_seconds = measure(seconds);
+    atomic_store(&typing.is_stopping, true);
+    pthread_join(typing_thread, NULL);
+    print_stats("busy", sessions, busy_count, seconds, cpu_seconds);
+    print_stats("typing", sessions + busy_count, typing_count, seconds, cpu_seconds);
+
+    for (int i = 0; i < parked_count; i++) {
+        sched57_remove(sessions[i]);
+    }
+    churn(&sched, calcs, infos, typing_count > 0 ? typing_count : 1, rounds);
+    printf("churn: %d rounds\n", rounds);
+
+    sched57_stop(&sched);
+    arena57_destroy(&arena);
+    free(sessions);
+    free(infos);
+    free(calcs);
+    return 0;
+}
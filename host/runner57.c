@@ -0,0 +1,268 @@
+#include "runner57.h"
+
+#include <string.h>
+#include <time.h>
+
+// The emulated time after a key press, so that the ROM sees the key even if it is released right
+// away. Same as the iOS app. It is run ahead of the host clock, and taken from the next runs.
+#define KEY_PRESS_MS 50
+
+static long long get_time_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/** Copies 'size' bytes from 'src' to 'words', see RUNNER57_WORDS. */
+static void store_words(atomic_ulong *words, const void *src, size_t size)
+{
+    for (size_t i = 0; i * sizeof(unsigned long) < size; i++) {
+        unsigned long word = 0;
+        size_t offset = i * sizeof(unsigned long);
+        size_t n = size - offset < sizeof(word) ? size - offset : sizeof(word);
+        memcpy(&word, (const char *)src + offset, n);
+        atomic_store_explicit(&words[i], word, memory_order_relaxed);
+    }
+}
+
+/** Copies 'size' bytes from 'words' to 'dst', see RUNNER57_WORDS. */
+static void load_words(void *dst, atomic_ulong *words, size_t size)
+{
+    for (size_t i = 0; i * sizeof(unsigned long) < size; i++) {
+        unsigned long word = atomic_load_explicit(&words[i], memory_order_relaxed);
+        size_t offset = i * sizeof(unsigned long);
+        size_t n = size - offset < sizeof(word) ? size - offset : sizeof(word);
+        memcpy((char *)dst + offset, &word, n);
+    }
+}
+
+/**
+ * KEY QUEUE
+ */
+
+static bool push_key(runner57_t *runner, int row, int col)
+{
+    unsigned int head = atomic_load_explicit(&runner->key_head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&runner->key_tail, memory_order_acquire);
+
+    if (head - tail == RUNNER57_KEY_QUEUE_SIZE) return false;
+
+    runner57_key_event_t *event = &runner->keys[head % RUNNER57_KEY_QUEUE_SIZE];
+    event->row = row;
+    event->col = col;
+    event->time_ns = get_time_ns();
+    atomic_store_explicit(&runner->key_head, head + 1, memory_order_release);
+
+    // Wake the worker up. Holding the mutex ensures that the wakeup is not lost if the worker is
+    // about to sleep.
+    pthread_mutex_lock(&runner->mutex);
+    pthread_cond_signal(&runner->cond);
+    pthread_mutex_unlock(&runner->mutex);
+    return true;
+}
+
+static bool has_key(runner57_t *runner)
+{
+    return atomic_load_explicit(&runner->key_head, memory_order_acquire) !=
+           atomic_load_explicit(&runner->key_tail, memory_order_relaxed);
+}
+
+/** Sends the waiting key events to the emulator. */
+static void process_keys(runner57_t *runner)
+{
+    rcl57_t *rcl57 = runner->rcl57;
+    unsigned int tail = atomic_load_explicit(&runner->key_tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&runner->key_head, memory_order_acquire);
+
+    for ( ; tail != head; tail++) {
+        runner57_key_event_t *event = &runner->keys[tail % RUNNER57_KEY_QUEUE_SIZE];
+        if (event->row) {
+            // The ROM must be done with the last key first, or it may miss the press.
+            for (int ms = 0; ms < KEY_PRESS_MS && rcl57_is_release_pending(rcl57); ms++) {
+                rcl57_advance_ahead(rcl57, 1);
+            }
+            rcl57_key_press(rcl57, event->row, event->col);
+            rcl57_advance_ahead(rcl57, KEY_PRESS_MS);
+        } else {
+            rcl57_key_release(rcl57);
+        }
+        runner->key_time_ns = event->time_ns;
+    }
+    atomic_store_explicit(&runner->key_tail, tail, memory_order_release);
+}
+
+/**
+ * PUBLISHING
+ */
+
+static void publish_frame(runner57_t *runner)
+{
+    rcl57_t *rcl57 = runner->rcl57;
+    ti57_t *ti57 = &rcl57->ti57;
+    runner57_frame_t frame;
+
+    strcpy(frame.display, rcl57_get_display(rcl57));
+    frame.leds = *rcl57_get_display_frame(rcl57);
+    frame.mode = ti57->mode;
+    frame.activity = ti57->activity;
+    frame.timestamps = ti57->timestamps;
+    frame.logged_count = runner->published_log_count;
+    frame.log_timestamp = ti57->log.timestamp;
+    frame.cycle = ti57->current_cycle;
+    frame.time_ns = get_time_ns();
+    frame.key_time_ns = runner->key_time_ns;
+
+    unsigned int seq = atomic_load_explicit(&runner->frame_seq, memory_order_relaxed);
+    atomic_store_explicit(&runner->frame_seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    store_words(runner->frame, &frame, sizeof(frame));
+    atomic_store_explicit(&runner->frame_seq, seq + 2, memory_order_release);
+}
+
+/** Publishes the entries logged since the last run, and the last entry, which may have changed. */
+static void publish_log(runner57_t *runner)
+{
+    log57_t *log = &runner->rcl57->ti57.log;
+    long first = runner->published_log_count > 0 ? runner->published_log_count : 1;
+
+    // Entries that are no longer in the log or would not fit in the ring are skipped.
+    long oldest = log->logged_count - RUNNER57_LOG_RING_SIZE + 1;
+    if (oldest < log->logged_count - LOG57_MAX_ENTRY_COUNT + 1) {
+        oldest = log->logged_count - LOG57_MAX_ENTRY_COUNT + 1;
+    }
+    if (first < oldest) {
+        first = oldest;
+    }
+
+    for (long i = first; i <= log->logged_count; i++) {
+        runner57_log_slot_t *slot = &runner->log_ring[i % RUNNER57_LOG_RING_SIZE];
+        atomic_store_explicit(&slot->seq, 2 * i - 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        store_words(slot->entry, log57_get_entry(log, i), sizeof(log57_entry_t));
+        atomic_store_explicit(&slot->seq, 2 * i, memory_order_release);
+    }
+    runner->published_log_count = log->logged_count;
+}
+
+/**
+ * WORKER
+ */
+
+/** Sleeps for 'ms' (forever if negative), or until a key event is sent or the runner stops. */
+static void sleep_ms(runner57_t *runner, int ms)
+{
+    long long deadline_ns = get_time_ns() + ms * 1000000LL;
+    struct timespec deadline = {deadline_ns / 1000000000, deadline_ns % 1000000000};
+
+    pthread_mutex_lock(&runner->mutex);
+    if (!has_key(runner) && !atomic_load(&runner->is_stopping)) {
+        if (ms < 0) {
+            pthread_cond_wait(&runner->cond, &runner->mutex);
+        } else {
+            pthread_cond_timedwait(&runner->cond, &runner->mutex, &deadline);
+        }
+    }
+    pthread_mutex_unlock(&runner->mutex);
+}
+
+static void *run(void *arg)
+{
+    runner57_t *runner = arg;
+    rcl57_t *rcl57 = runner->rcl57;
+
+    while (!atomic_load(&runner->is_stopping)) {
+        process_keys(runner);
+        rcl57_advance_to(rcl57, get_time_ns());
+        publish_log(runner);
+        publish_frame(runner);
+
+        int wakeup_ms = rcl57_get_wakeup_ms(rcl57);
+        if (wakeup_ms != RCL57_WAKEUP_NEVER && wakeup_ms < runner->busy_period_ms) {
+            wakeup_ms = runner->busy_period_ms;
+        }
+        sleep_ms(runner, wakeup_ms);
+    }
+    return NULL;
+}
+
+/**
+ * API IMPLEMENTATION
+ */
+
+bool runner57_start(runner57_t *runner, rcl57_t *rcl57, int busy_period_ms)
+{
+    memset(runner, 0, sizeof(runner57_t));
+    runner->rcl57 = rcl57;
+    runner->busy_period_ms = busy_period_ms > 0 ? busy_period_ms : RUNNER57_DEFAULT_BUSY_PERIOD_MS;
+    pthread_mutex_init(&runner->mutex, NULL);
+
+    // The deadlines of the worker are on the monotonic clock, like the emulator.
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&runner->cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    // Start the clock of the emulator now, and publish a first frame for early readers.
+    rcl57->pacing.is_started = false;
+    rcl57_advance_to(rcl57, get_time_ns());
+    publish_log(runner);
+    publish_frame(runner);
+
+    if (pthread_create(&runner->thread, NULL, run, runner) != 0) {
+        pthread_cond_destroy(&runner->cond);
+        pthread_mutex_destroy(&runner->mutex);
+        return false;
+    }
+    return true;
+}
+
+void runner57_stop(runner57_t *runner)
+{
+    pthread_mutex_lock(&runner->mutex);
+    atomic_store(&runner->is_stopping, true);
+    pthread_cond_signal(&runner->cond);
+    pthread_mutex_unlock(&runner->mutex);
+
+    pthread_join(runner->thread, NULL);
+    pthread_cond_destroy(&runner->cond);
+    pthread_mutex_destroy(&runner->mutex);
+}
+
+bool runner57_key_press(runner57_t *runner, int row, int col)
+{
+    return push_key(runner, row, col);
+}
+
+bool runner57_key_release(runner57_t *runner)
+{
+    return push_key(runner, 0, 0);
+}
+
+void runner57_read_frame(runner57_t *runner, runner57_frame_t *frame)
+{
+    for (;;) {
+        unsigned int seq = atomic_load_explicit(&runner->frame_seq, memory_order_acquire);
+        if (seq & 1) continue;
+        load_words(frame, runner->frame, sizeof(runner57_frame_t));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&runner->frame_seq, memory_order_relaxed) == seq) return;
+    }
+}
+
+bool runner57_read_log_entry(runner57_t *runner, long index, log57_entry_t *entry)
+{
+    runner57_log_slot_t *slot = &runner->log_ring[index % RUNNER57_LOG_RING_SIZE];
+
+    if (index < 1) return false;
+    for (;;) {
+        long seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (seq == 2 * index - 1) continue;
+        if (seq != 2 * index) return false;
+        load_words(entry, slot->entry, sizeof(log57_entry_t));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->seq, memory_order_relaxed) == seq) return true;
+    }
+}
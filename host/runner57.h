@@ -0,0 +1,120 @@
+/**
+ * Running a RCL-57 on a dedicated thread.
+ *
+ * The runner owns a 'rcl57_t' and advances it on a worker thread, paced by the host clock (see
+ * 'rcl57_advance_to'), so that the emulator and the UI never wait for each other:
+ * - key events are sent to the worker through a single-producer single-consumer queue
+ * - after each run, the worker publishes a frame with the display, the modes and the timestamps,
+ *   under a seqlock
+ * - the worker publishes the log entries in a ring, each slot with its own sequence number
+ *
+ * Reading never blocks the worker. Sending a key event only takes a mutex to wake the worker up,
+ * which the worker only holds while going to sleep.
+ *
+ * Key events should be sent by a single thread. Frames and log entries may be read from any
+ * thread. The 'rcl57_t' must not be accessed by other threads while the runner is running.
+ */
+
+#ifndef runner57_h
+#define runner57_h
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "rcl57.h"
+
+/** The number of key events that may be waiting for the worker. */
+#define RUNNER57_KEY_QUEUE_SIZE 64
+
+/** The number of log entries that can be read back. */
+#define RUNNER57_LOG_RING_SIZE 256
+
+/** The default of 'busy_period_ms'. */
+#define RUNNER57_DEFAULT_BUSY_PERIOD_MS 10
+
+/**
+ * The words of the data published under a sequence number. They are copied with relaxed atomic
+ * accesses, so that a reader racing with the worker gets a copy it then discards rather than a data
+ * race.
+ */
+#define RUNNER57_WORDS(type) ((sizeof(type) + sizeof(unsigned long) - 1) / sizeof(unsigned long))
+
+/** What the UI needs after each run. */
+typedef struct runner57_frame_s {
+    char display[26];               // As returned by 'rcl57_get_display'.
+    ti57_frame_t leds;              // As returned by 'rcl57_get_display_frame'.
+    ti57_mode_t mode;
+    ti57_activity_t activity;
+    ti57_timestamps_t timestamps;   // See 'ti57_changes_since'.
+    long logged_count;              // See 'log57_get_logged_count'.
+    long log_timestamp;             // Changes whenever the log changes.
+    unsigned long cycle;            // The current cycle of the emulator.
+    long long time_ns;              // The host time at the end of the run.
+    long long key_time_ns;          // The host time the last key event processed was sent.
+} runner57_frame_t;
+
+typedef struct runner57_key_event_s {
+    int row, col;                   // 0 for a key release.
+    long long time_ns;              // The host time the event was sent.
+} runner57_key_event_t;
+
+typedef struct runner57_log_slot_s {
+    atomic_long seq;                // 2 * the index of the entry, odd while being written.
+    atomic_ulong entry[RUNNER57_WORDS(log57_entry_t)];
+} runner57_log_slot_t;
+
+typedef struct runner57_s {
+    rcl57_t *rcl57;
+    int busy_period_ms;             // The time between 2 runs while the calculator is busy.
+
+    pthread_t thread;
+    pthread_mutex_t mutex;          // Only used to put the worker to sleep and to wake it up.
+    pthread_cond_t cond;
+    atomic_bool is_stopping;
+
+    // Key events, from the UI to the worker.
+    runner57_key_event_t keys[RUNNER57_KEY_QUEUE_SIZE];
+    atomic_uint key_head;           // Written by the UI.
+    atomic_uint key_tail;           // Written by the worker.
+    long long key_time_ns;          // The time of the last key event processed by the worker.
+
+    // The last frame, from the worker to the UI.
+    atomic_uint frame_seq;          // Odd while the frame is being written.
+    atomic_ulong frame[RUNNER57_WORDS(runner57_frame_t)];
+
+    // The log entries, from the worker to the UI.
+    runner57_log_slot_t log_ring[RUNNER57_LOG_RING_SIZE];
+    long published_log_count;       // The number of entries published by the worker.
+} runner57_t;
+
+/**
+ * Starts running 'rcl57' on a new thread, every 'busy_period_ms' while the calculator is busy (0
+ * for the default).
+ *
+ * Returns false if the thread could not be created.
+ */
+bool runner57_start(runner57_t *runner, rcl57_t *rcl57, int busy_period_ms);
+
+/** Stops the worker and waits for it. The 'rcl57_t' may then be used again by the caller. */
+void runner57_stop(runner57_t *runner);
+
+/** Sends a key press to the worker. Returns false if too many key events are waiting. */
+bool runner57_key_press(runner57_t *runner, int row, int col);
+
+/** Sends a key release to the worker. Returns false if too many key events are waiting. */
+bool runner57_key_release(runner57_t *runner);
+
+/** Copies the last published frame into 'frame'. Never blocks the worker. */
+void runner57_read_frame(runner57_t *runner, runner57_frame_t *frame);
+
+/**
+ * Copies the log entry at 'index' (1 for the first entry) into 'entry'.
+ *
+ * Returns false if the entry has not been published yet or is no longer in the ring. The last
+ * entry may still change, for instance while a number is being entered: it should be read again
+ * when 'log_timestamp' changes.
+ */
+bool runner57_read_log_entry(runner57_t *runner, long index, log57_entry_t *entry);
+
+#endif  /* !runner57_h */
@@ -0,0 +1,555 @@
+#include "sched57.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// The emulated time after a key press, so that the ROM sees the key even if it is released right
+// away. Same as the iOS app. It is run ahead of the host clock, and taken from the catch up.
+#define KEY_PRESS_MS 50
+
+// The number of due timers handled at once.
+#define MAX_DUE_TIMERS 64
+
+typedef enum session_state_e {
+    PARKED,
+    SLEEPING,
+    QUEUED,
+    RUNNING,
+    REMOVED,
+} session_state_t;
+
+static long long get_time_ns(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * RUN QUEUES
+ */
+
+/** Wakes an idle worker up, if any. */
+static void wake_worker(sched57_t *sched)
+{
+    if (atomic_load(&sched->idle_count) > 0) {
+        pthread_mutex_lock(&sched->mutex);
+        pthread_cond_signal(&sched->cond);
+        pthread_mutex_unlock(&sched->mutex);
+    }
+}
+
+/** Queues a session that has just become runnable at 'ready_time_ns'. */
+static void enqueue(sched57_t *sched, int index, sched57_session_t *session,
+                    long long ready_time_ns)
+{
+    sched57_queue_t *queue = &sched->queues[index];
+    int size = sched->config.max_session_count;
+
+    session->ready_time_ns = ready_time_ns;
+    pthread_mutex_lock(&queue->mutex);
+    queue->sessions[(queue->head + queue->count) % size] = session;
+    queue->count += 1;
+    pthread_mutex_unlock(&queue->mutex);
+
+    atomic_fetch_add(&sched->queued_count, 1);
+    wake_worker(sched);
+}
+
+/** Takes the first session of a queue, or the last one when stealing. */
+static sched57_session_t *dequeue(sched57_t *sched, int index, bool is_stealing)
+{
+    sched57_queue_t *queue = &sched->queues[index];
+    int size = sched->config.max_session_count;
+    sched57_session_t *session = NULL;
+
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->count > 0) {
+        if (is_stealing) {
+            session = queue->sessions[(queue->head + queue->count - 1) % size];
+        } else {
+            session = queue->sessions[queue->head];
+            queue->head = (queue->head + 1) % size;
+        }
+        queue->count -= 1;
+    }
+    pthread_mutex_unlock(&queue->mutex);
+
+    if (session) {
+        atomic_fetch_sub(&sched->queued_count, 1);
+    }
+    return session;
+}
+
+/**
+ * Queues a session if it is parked or sleeping. If it is already queued or running, its next slice
+ * will see the key events.
+ */
+static void wake_session(sched57_session_t *session, int index, long long ready_time_ns)
+{
+    sched57_t *sched = session->sched;
+
+    for (;;) {
+        int state = atomic_load(&session->state);
+        if (state != PARKED && state != SLEEPING) return;
+        if (atomic_compare_exchange_weak(&session->state, &state, QUEUED)) break;
+    }
+    enqueue(sched, index, session, ready_time_ns);
+}
+
+/**
+ * TIMERS
+ *
+ * The timers are only accessed with 'sched->mutex' held.
+ */
+
+static void update_next_timer(sched57_t *sched)
+{
+    atomic_store(&sched->next_timer_ns, sched->timer_count > 0 ? sched->timers[0].time_ns
+                                                                : LLONG_MAX);
+}
+
+static void sift_up(sched57_t *sched, int i)
+{
+    sched57_timer_t *timers = sched->timers;
+
+    while (i > 0 && timers[(i - 1) / 2].time_ns > timers[i].time_ns) {
+        sched57_timer_t timer = timers[i];
+        timers[i] = timers[(i - 1) / 2];
+        timers[(i - 1) / 2] = timer;
+        i = (i - 1) / 2;
+    }
+}
+
+static void sift_down(sched57_t *sched, int i)
+{
+    sched57_timer_t *timers = sched->timers;
+
+    for (;;) {
+        int min = i;
+        if (2 * i + 1 < sched->timer_count && timers[2 * i + 1].time_ns < timers[min].time_ns) {
+            min = 2 * i + 1;
+        }
+        if (2 * i + 2 < sched->timer_count && timers[2 * i + 2].time_ns < timers[min].time_ns) {
+            min = 2 * i + 2;
+        }
+        if (min == i) return;
+        sched57_timer_t timer = timers[i];
+        timers[i] = timers[min];
+        timers[min] = timer;
+        i = min;
+    }
+}
+
+/** Wakes a sleeping session up at 'time_ns'. */
+static void add_timer(sched57_t *sched, sched57_session_t *session, unsigned long generation,
+                      long long time_ns)
+{
+    pthread_mutex_lock(&sched->mutex);
+    if (sched->timer_count == sched->timer_capacity) {
+        int capacity = 2 * sched->timer_capacity;
+        sched57_timer_t *timers = realloc(sched->timers, capacity * sizeof(sched57_timer_t));
+        if (timers == NULL) {
+            // Run the session again right away rather than losing it.
+            pthread_mutex_unlock(&sched->mutex);
+            wake_session(session, 0, time_ns);
+            return;
+        }
+        sched->timers = timers;
+        sched->timer_capacity = capacity;
+    }
+    sched->timers[sched->timer_count] = (sched57_timer_t){time_ns, generation, session};
+    sched->timer_count += 1;
+    sift_up(sched, sched->timer_count - 1);
+
+    // Idle workers may be waiting for a later timer.
+    if (sched->timers[0].session == session) {
+        update_next_timer(sched);
+        pthread_cond_signal(&sched->cond);
+    }
+    pthread_mutex_unlock(&sched->mutex);
+}
+
+/** Queues the sessions whose timers are due into the queue 'index'. */
+static void run_timers(sched57_t *sched, int index, long long now_ns)
+{
+    while (now_ns >= atomic_load(&sched->next_timer_ns)) {
+        sched57_session_t *sessions[MAX_DUE_TIMERS];
+        long long times_ns[MAX_DUE_TIMERS];
+        int n = 0;
+
+        pthread_mutex_lock(&sched->mutex);
+        while (n < MAX_DUE_TIMERS && sched->timer_count > 0 &&
+               sched->timers[0].time_ns <= now_ns) {
+            sched57_timer_t timer = sched->timers[0];
+            sched->timer_count -= 1;
+            sched->timers[0] = sched->timers[sched->timer_count];
+            sift_down(sched, 0);
+
+            // Timers from an earlier sleep are ignored.
+            sched57_session_t *session = timer.session;
+            int state = SLEEPING;
+            if (atomic_load(&session->timer_generation) == timer.generation &&
+                atomic_compare_exchange_strong(&session->state, &state, QUEUED)) {
+                sessions[n] = session;
+                times_ns[n] = timer.time_ns;
+                n++;
+            }
+        }
+        update_next_timer(sched);
+        pthread_mutex_unlock(&sched->mutex);
+
+        for (int i = 0; i < n; i++) {
+            enqueue(sched, index, sessions[i], times_ns[i]);
+        }
+    }
+}
+
+/** Removes the timers of a session. */
+static void remove_timers(sched57_t *sched, sched57_session_t *session)
+{
+    pthread_mutex_lock(&sched->mutex);
+    int n = 0;
+    for (int i = 0; i < sched->timer_count; i++) {
+        if (sched->timers[i].session != session) {
+            sched->timers[n++] = sched->timers[i];
+        }
+    }
+    sched->timer_count = n;
+    for (int i = n / 2 - 1; i >= 0; i--) {
+        sift_down(sched, i);
+    }
+    update_next_timer(sched);
+    pthread_mutex_unlock(&sched->mutex);
+}
+
+/**
+ * WORKERS
+ */
+
+/** Processes the key events of a session and catches up with the host clock. */
+static void run_slice(sched57_t *sched, int index, sched57_session_t *session)
+{
+    rcl57_t *rcl57 = session->rcl57;
+    long long start_ns = get_time_ns(CLOCK_MONOTONIC);
+    long long start_cpu_ns = get_time_ns(CLOCK_THREAD_CPUTIME_ID);
+    unsigned long start_cycle = rcl57->ti57.current_cycle;
+    long long key_latency_ns = 0, max_key_latency_ns = 0;
+    sched57_key_event_t keys[SCHED57_KEY_QUEUE_SIZE];
+
+    // Take the key events whose presses fit in the slice, and at least one press. The others wait
+    // for the next slices. A press may first wait up to KEY_PRESS_MS for the ROM to be done with
+    // the last key.
+    pthread_mutex_lock(&session->mutex);
+    int key_count = 0;
+    for (int press_ms = 0; key_count < session->key_count; key_count++) {
+        if (session->keys[key_count].row) {
+            if (press_ms > 0 && press_ms + 2 * KEY_PRESS_MS > sched->config.slice_ms) break;
+            press_ms += 2 * KEY_PRESS_MS;
+        }
+    }
+    memcpy(keys, session->keys, key_count * sizeof(keys[0]));
+    session->key_count -= key_count;
+    memmove(session->keys, session->keys + key_count, session->key_count * sizeof(keys[0]));
+    pthread_mutex_unlock(&session->mutex);
+
+    // The presses are run ahead of the host clock, which the catch up then runs that much less.
+    for (int i = 0; i < key_count; i++) {
+        if (keys[i].row) {
+            // The ROM must be done with the last key first, or it may miss the press.
+            for (int ms = 0; ms < KEY_PRESS_MS && rcl57_is_release_pending(rcl57); ms++) {
+                rcl57_advance_ahead(rcl57, 1);
+            }
+            rcl57_key_press(rcl57, keys[i].row, keys[i].col);
+            rcl57_advance_ahead(rcl57, KEY_PRESS_MS);
+        } else {
+            rcl57_key_release(rcl57);
+        }
+        long long latency_ns = start_ns - keys[i].time_ns;
+        key_latency_ns += latency_ns;
+        if (latency_ns > max_key_latency_ns) {
+            max_key_latency_ns = latency_ns;
+        }
+    }
+
+    rcl57_advance_to(rcl57, start_ns);
+    if (sched->config.on_slice) {
+        sched->config.on_slice(session);
+    }
+    int wakeup_ms = rcl57_get_wakeup_ms(rcl57);
+
+    long long wait_ns = start_ns - session->ready_time_ns;
+    pthread_mutex_lock(&session->mutex);
+    sched57_stats_t *stats = &session->stats;
+    stats->slice_count += 1;
+    stats->cycle_count += rcl57->ti57.current_cycle - start_cycle;
+    stats->cpu_ns += get_time_ns(CLOCK_THREAD_CPUTIME_ID) - start_cpu_ns;
+    stats->wait_ns += wait_ns;
+    if (wait_ns > stats->max_wait_ns) {
+        stats->max_wait_ns = wait_ns;
+    }
+    stats->key_count += key_count;
+    stats->key_latency_ns += key_latency_ns;
+    if (max_key_latency_ns > stats->max_key_latency_ns) {
+        stats->max_key_latency_ns = max_key_latency_ns;
+    }
+    bool has_keys = session->key_count > 0;
+    pthread_mutex_unlock(&session->mutex);
+
+    if (atomic_load(&session->is_removed)) {
+        atomic_store(&session->state, PARKED);
+        return;
+    }
+
+    if (wakeup_ms == RCL57_WAKEUP_NEVER) {
+        atomic_store(&session->state, PARKED);
+    } else {
+        if (wakeup_ms < sched->config.busy_period_ms) {
+            wakeup_ms = sched->config.busy_period_ms;
+        }
+        unsigned long generation = atomic_fetch_add(&session->timer_generation, 1) + 1;
+        atomic_store(&session->state, SLEEPING);
+        add_timer(sched, session, generation, start_ns + (long long)wakeup_ms * 1000000);
+    }
+
+    // Key events sent during the slice may not have woken the session up.
+    if (!has_keys) {
+        pthread_mutex_lock(&session->mutex);
+        has_keys = session->key_count > 0;
+        pthread_mutex_unlock(&session->mutex);
+    }
+    if (has_keys) {
+        wake_session(session, index, start_ns);
+    }
+}
+
+/** Waits for a session to be queued or for the next timer. */
+static void wait_for_work(sched57_t *sched)
+{
+    pthread_mutex_lock(&sched->mutex);
+    atomic_fetch_add(&sched->idle_count, 1);
+    if (atomic_load(&sched->queued_count) <= 0 && !atomic_load(&sched->is_stopping)) {
+        long long next_timer_ns = atomic_load(&sched->next_timer_ns);
+        if (next_timer_ns == LLONG_MAX) {
+            pthread_cond_wait(&sched->cond, &sched->mutex);
+        } else {
+            struct timespec deadline = {next_timer_ns / 1000000000, next_timer_ns % 1000000000};
+            pthread_cond_timedwait(&sched->cond, &sched->mutex, &deadline);
+        }
+    }
+    atomic_fetch_sub(&sched->idle_count, 1);
+    pthread_mutex_unlock(&sched->mutex);
+}
+
+static void *work(void *arg)
+{
+    sched57_queue_t *queue = arg;
+    sched57_t *sched = queue->sched;
+    int index = (int)(queue - sched->queues);
+    int worker_count = sched->config.worker_count;
+
+    while (!atomic_load(&sched->is_stopping)) {
+        run_timers(sched, index, get_time_ns(CLOCK_MONOTONIC));
+
+        sched57_session_t *session = dequeue(sched, index, false);
+        for (int i = 1; session == NULL && i < worker_count; i++) {
+            session = dequeue(sched, (index + i) % worker_count, true);
+        }
+        if (session == NULL) {
+            wait_for_work(sched);
+            continue;
+        }
+
+        if (atomic_load(&session->is_removed)) {
+            atomic_store(&session->state, PARKED);
+            continue;
+        }
+        // The slice may still use the session after parking it or putting it to sleep.
+        atomic_fetch_add(&session->active_slice_count, 1);
+        atomic_store(&session->state, RUNNING);
+        run_slice(sched, index, session);
+        atomic_fetch_sub(&session->active_slice_count, 1);
+    }
+    return NULL;
+}
+
+/**
+ * API IMPLEMENTATION
+ */
+
+static bool push_key(sched57_session_t *session, int row, int col)
+{
+    sched57_t *sched = session->sched;
+    long long time_ns = get_time_ns(CLOCK_MONOTONIC);
+
+    pthread_mutex_lock(&session->mutex);
+    if (session->key_count == SCHED57_KEY_QUEUE_SIZE) {
+        pthread_mutex_unlock(&session->mutex);
+        return false;
+    }
+    session->keys[session->key_count].row = row;
+    session->keys[session->key_count].col = col;
+    session->keys[session->key_count].time_ns = time_ns;
+    session->key_count += 1;
+    pthread_mutex_unlock(&session->mutex);
+
+    unsigned int next_queue = atomic_fetch_add(&sched->next_queue, 1);
+    wake_session(session, next_queue % sched->config.worker_count, time_ns);
+    return true;
+}
+
+static void free_queues(sched57_t *sched, int n)
+{
+    for (int i = 0; i < n; i++) {
+        pthread_mutex_destroy(&sched->queues[i].mutex);
+        free(sched->queues[i].sessions);
+    }
+}
+
+bool sched57_start(sched57_t *sched, const sched57_config_t *config)
+{
+    memset(sched, 0, sizeof(sched57_t));
+    sched->config = *config;
+    if (sched->config.worker_count <= 0) {
+        sched->config.worker_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (sched->config.worker_count < 1) {
+        sched->config.worker_count = 1;
+    } else if (sched->config.worker_count > SCHED57_MAX_WORKERS) {
+        sched->config.worker_count = SCHED57_MAX_WORKERS;
+    }
+    if (sched->config.slice_ms <= 0) {
+        sched->config.slice_ms = SCHED57_DEFAULT_SLICE_MS;
+    }
+    if (sched->config.busy_period_ms <= 0) {
+        sched->config.busy_period_ms = SCHED57_DEFAULT_BUSY_PERIOD_MS;
+    }
+    if (sched->config.max_session_count < 1) return false;
+
+    int worker_count = sched->config.worker_count;
+    for (int i = 0; i < worker_count; i++) {
+        sched57_queue_t *queue = &sched->queues[i];
+        queue->sched = sched;
+        queue->sessions = malloc(sched->config.max_session_count * sizeof(sched57_session_t *));
+        if (queue->sessions == NULL) {
+            free_queues(sched, i);
+            return false;
+        }
+        pthread_mutex_init(&queue->mutex, NULL);
+    }
+    sched->timer_capacity = sched->config.max_session_count;
+    sched->timers = malloc(sched->timer_capacity * sizeof(sched57_timer_t));
+    if (sched->timers == NULL) {
+        free_queues(sched, worker_count);
+        return false;
+    }
+    atomic_store(&sched->next_timer_ns, LLONG_MAX);
+
+    // Timers are on the monotonic clock.
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&sched->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&sched->mutex, NULL);
+
+    for (int i = 0; i < worker_count; i++) {
+        if (pthread_create(&sched->threads[i], NULL, work, &sched->queues[i]) != 0) {
+            sched->config.worker_count = i;
+            sched57_stop(sched);
+            return false;
+        }
+    }
+    return true;
+}
+
+void sched57_stop(sched57_t *sched)
+{
+    pthread_mutex_lock(&sched->mutex);
+    atomic_store(&sched->is_stopping, true);
+    pthread_cond_broadcast(&sched->cond);
+    pthread_mutex_unlock(&sched->mutex);
+
+    for (int i = 0; i < sched->config.worker_count; i++) {
+        pthread_join(sched->threads[i], NULL);
+    }
+    free_queues(sched, sched->config.worker_count);
+    free(sched->timers);
+    pthread_cond_destroy(&sched->cond);
+    pthread_mutex_destroy(&sched->mutex);
+}
+
+sched57_session_t *sched57_add(sched57_t *sched, rcl57_t *rcl57, void *user)
+{
+    if (atomic_fetch_add(&sched->session_count, 1) >= sched->config.max_session_count) {
+        atomic_fetch_sub(&sched->session_count, 1);
+        return NULL;
+    }
+    sched57_session_t *session = calloc(1, sizeof(sched57_session_t));
+    if (session == NULL) {
+        atomic_fetch_sub(&sched->session_count, 1);
+        return NULL;
+    }
+    session->sched = sched;
+    session->rcl57 = rcl57;
+    session->user = user;
+    pthread_mutex_init(&session->mutex, NULL);
+
+    // A slice catches up with at most 'slice_ms'.
+    rcl57->pacing.is_started = false;
+    rcl57->pacing.max_catch_up_ms = sched->config.slice_ms;
+
+    // Run a first slice to find out when the session should run again.
+    atomic_store(&session->state, QUEUED);
+    unsigned int next_queue = atomic_fetch_add(&sched->next_queue, 1);
+    enqueue(sched, next_queue % sched->config.worker_count, session,
+            get_time_ns(CLOCK_MONOTONIC));
+    return session;
+}
+
+void sched57_remove(sched57_session_t *session)
+{
+    sched57_t *sched = session->sched;
+
+    // Once removed, the session is parked after its slice, if it is queued or running.
+    atomic_store(&session->is_removed, true);
+    for (;;) {
+        int state = atomic_load(&session->state);
+        if ((state == PARKED || state == SLEEPING) &&
+            atomic_compare_exchange_strong(&session->state, &state, REMOVED)) {
+            break;
+        }
+        usleep(1000);
+    }
+    // No slice can start once removed, but the last one may still be adding a timer.
+    while (atomic_load(&session->active_slice_count) > 0) {
+        usleep(1000);
+    }
+    remove_timers(sched, session);
+
+    session->rcl57->pacing.max_catch_up_ms = RCL57_DEFAULT_MAX_CATCH_UP_MS;
+    pthread_mutex_destroy(&session->mutex);
+    free(session);
+    atomic_fetch_sub(&sched->session_count, 1);
+}
+
+bool sched57_key_press(sched57_session_t *session, int row, int col)
+{
+    return push_key(session, row, col);
+}
+
+bool sched57_key_release(sched57_session_t *session)
+{
+    return push_key(session, 0, 0);
+}
+
+void sched57_get_stats(sched57_session_t *session, sched57_stats_t *stats)
+{
+    pthread_mutex_lock(&session->mutex);
+    *stats = session->stats;
+    pthread_mutex_unlock(&session->mutex);
+}
@@ -0,0 +1,153 @@
+/**
+ * Running many RCL-57 sessions on a pool of worker threads.
+ *
+ * Each session owns a 'rcl57_t' paced by the host clock (see 'rcl57_advance_to'). A session is
+ * always in one of these states:
+ * - parked: the calculator waits for a key event. It is in no queue and costs nothing until the
+ *   next key event.
+ * - sleeping: the calculator is pausing or blinking, or is busy between 2 slices. It is in a timer
+ *   heap until its next wakeup (see 'rcl57_get_wakeup_ms').
+ * - queued: it is in the run queue of a worker, waiting for a slice.
+ * - running: a worker is running a slice.
+ *
+ * A slice processes the waiting key events and catches up with the host clock, for at most
+ * 'slice_ms' of emulated time (or a single key press if longer), so that a session that fell behind
+ * or received many keys cannot hold a worker for long. Each key press is held for some emulated
+ * time, taken from the catch up: the key events that don't fit wait for the next slices.
+ * Each worker runs the sessions of its own queue in order, and steals from the other queues when
+ * its own is empty.
+ *
+ * Key events may be sent from any thread. The 'rcl57_t' of a session must only be accessed from
+ * the 'on_slice' callback, or once the session has been removed.
+ */
+
+#ifndef sched57_h
+#define sched57_h
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "rcl57.h"
+
+/** The maximum number of workers. */
+#define SCHED57_MAX_WORKERS 64
+
+/** The number of key events that may be waiting for a session. */
+#define SCHED57_KEY_QUEUE_SIZE 16
+
+/** The default of 'slice_ms'. */
+#define SCHED57_DEFAULT_SLICE_MS 50
+
+/** The default of 'busy_period_ms'. */
+#define SCHED57_DEFAULT_BUSY_PERIOD_MS 10
+
+/** The accounting of a session. */
+typedef struct sched57_stats_s {
+    long slice_count;
+    unsigned long cycle_count;     // The emulated cycles.
+    long long cpu_ns;              // The CPU time of the slices.
+    long long wait_ns;             // The total time between becoming runnable and the slices.
+    long long max_wait_ns;
+    long key_count;
+    long long key_latency_ns;      // The total time between the key events and their slices.
+    long long max_key_latency_ns;
+} sched57_stats_t;
+
+typedef struct sched57_key_event_s {
+    int row, col;                  // 0 for a key release.
+    long long time_ns;             // The host time the event was sent.
+} sched57_key_event_t;
+
+typedef struct sched57_session_s {
+    struct sched57_s *sched;
+    rcl57_t *rcl57;
+    void *user;                    // For the client.
+
+    atomic_int state;              // See the states above.
+    atomic_bool is_removed;
+    atomic_int active_slice_count; // The slices in progress, which may outlive their state.
+    atomic_ulong timer_generation; // Timers from an earlier generation are ignored.
+    long long ready_time_ns;       // The host time the session became runnable.
+
+    pthread_mutex_t mutex;         // Protects the key events and the accounting.
+    sched57_key_event_t keys[SCHED57_KEY_QUEUE_SIZE];
+    int key_count;
+    sched57_stats_t stats;
+} sched57_session_t;
+
+/** Called by a worker after each slice of 'session'. */
+typedef void (*sched57_callback_t)(sched57_session_t *session);
+
+typedef struct sched57_config_s {
+    int worker_count;              // 0 for the number of CPUs.
+    int max_session_count;
+    int slice_ms;                  // The longest emulated time in a slice. 0 for the default.
+    int busy_period_ms;            // The time between 2 slices while busy. 0 for the default.
+    sched57_callback_t on_slice;   // May be NULL.
+} sched57_config_t;
+
+/** The run queue of a worker. */
+typedef struct sched57_queue_s {
+    struct sched57_s *sched;
+    pthread_mutex_t mutex;
+    sched57_session_t **sessions;  // A ring of 'max_session_count' sessions.
+    int head;
+    int count;
+} sched57_queue_t;
+
+typedef struct sched57_timer_s {
+    long long time_ns;
+    unsigned long generation;
+    sched57_session_t *session;
+} sched57_timer_t;
+
+typedef struct sched57_s {
+    sched57_config_t config;
+    atomic_int session_count;
+    atomic_bool is_stopping;
+
+    pthread_t threads[SCHED57_MAX_WORKERS];
+    sched57_queue_t queues[SCHED57_MAX_WORKERS];
+    atomic_int queued_count;       // The number of sessions in the run queues.
+    atomic_uint next_queue;        // The queue of the next session woken up by a key event.
+
+    // Idle workers and timers.
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    atomic_int idle_count;
+    sched57_timer_t *timers;       // A min-heap on 'time_ns'.
+    int timer_count;
+    int timer_capacity;
+    atomic_llong next_timer_ns;    // The time of the first timer, to check it without locking.
+} sched57_t;
+
+/** Starts the workers. Returns false if the scheduler could not be started. */
+bool sched57_start(sched57_t *sched, const sched57_config_t *config);
+
+/** Stops the workers and waits for them. The sessions should have been removed. */
+void sched57_stop(sched57_t *sched);
+
+/**
+ * Adds a session running 'rcl57', which is paced from now on.
+ *
+ * Returns NULL if there are already 'max_session_count' sessions or if the allocation failed.
+ */
+sched57_session_t *sched57_add(sched57_t *sched, rcl57_t *rcl57, void *user);
+
+/**
+ * Removes a session, waiting for its slice if it is queued or running. The 'rcl57_t' may then be
+ * used again by the caller.
+ */
+void sched57_remove(sched57_session_t *session);
+
+/** Sends a key press to a session. Returns false if too many key events are waiting. */
+bool sched57_key_press(sched57_session_t *session, int row, int col);
+
+/** Sends a key release to a session. Returns false if too many key events are waiting. */
+bool sched57_key_release(sched57_session_t *session);
+
+/** Copies the accounting of a session into 'stats'. */
+void sched57_get_stats(sched57_session_t *session, sched57_stats_t *stats);
+
+#endif  /* !sched57_h */
@@ -14,7 +14,7 @@ class Rcl57 {
     private static let versionKey = "version"
 
     /// Incremented by 1 for non backward compatible changes.
-    static let majorVersion = 1
+    static let majorVersion = 2
 
     /// Incremented by 1 for minor changes, and reset to 0 for non backward compatible changes.
     static let minorVersion = 1
@@ -38,22 +38,6 @@ class Rcl57 {
         rcl57_init(&rcl57)
     }
 
-    /// Returns the content at a given URL as a "char *".
-    private func rawData(atURL url: URL) -> UnsafePointer<CChar>? {
-        guard let data = try? Data(contentsOf: url) else {
-            return nil
-        }
-
-        var bytePointer: UnsafePointer<Int8>?
-        data.withUnsafeBytes { ptr in
-            if let baseAddress = ptr.baseAddress {
-                bytePointer = baseAddress.assumingMemoryBound(to: Int8.self)
-            }
-        }
-
-        return bytePointer
-    }
-
     /// Updates `version` if it has changed.
     private func updateVersion(stateURL: inout URL?) {
         if let previousVersion = UserDefaults.standard.string(forKey: Rcl57.versionKey) {
@@ -79,11 +63,21 @@ class Rcl57 {
 
         updateVersion(stateURL: &stateURL)
 
-        guard let stateURL, let rawData = rawData(atURL: stateURL) else {
-            rcl57_init(&rcl57)
+        rcl57_init(&rcl57)
+        guard let stateURL, let data = try? Data(contentsOf: stateURL) else {
             return
         }
-        memcpy(&rcl57, rawData, MemoryLayout.size(ofValue: rcl57))
+
+        // States that can't be restored, including the ones saved by older versions of the app as
+        // raw memory, are ignored.
+        let isRestored = data.withUnsafeBytes { ptr in
+            guard let baseAddress = ptr.baseAddress else { return false }
+            return save57_read(&rcl57, baseAddress.assumingMemoryBound(to: UInt8.self),
+                               Int32(data.count))
+        }
+        if !isRestored {
+            rcl57_init(&rcl57)
+        }
     }
 
 
@@ -170,6 +164,21 @@ class Rcl57 {
     }
 
 
+    // MARK: Changes.
+
+    /// A snapshot of the timestamps of the emulator state. See `changes(since:)`.
+    var timestamps: ti57_timestamps_t {
+        ti57_get_timestamps(&rcl57.ti57)
+    }
+
+    /// The parts of the emulator state that have changed since a given snapshot, as a combination of
+    /// `TI57_*_CHANGE` flags. See `state57.h`.
+    func changes(since snapshot: ti57_timestamps_t) -> Int32 {
+        var snapshot = snapshot
+        return ti57_changes_since(&rcl57.ti57, &snapshot)
+    }
+
+
     // MARK: Emulator.
 
     /// Controls the speed of the emulator.
@@ -217,8 +226,10 @@ class Rcl57 {
 
     /// Saves the Rcl57 object. Returns `true` if the object was saved successfully.
     func saveState() -> Bool {
-        let size = MemoryLayout.size(ofValue: rcl57)
-        let rawData = Data(bytes: &rcl57, count: size)
+        var buffer = [UInt8](repeating: 0, count: Int(SAVE57_MAX_SIZE))
+        let size = save57_write(&rcl57, &buffer, Int32(buffer.count), SAVE57_LOG_FLAG)
+        if size == 0 { return false }
+        let rawData = Data(buffer[0..<Int(size)])
         let dirURL: URL? =
             FileManager.default.urls(for: .documentDirectory, in: .userDomainMask).first
         let fileURL: URL? = dirURL?.appendingPathComponent(Rcl57.stateFilename)
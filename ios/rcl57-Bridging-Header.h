@@ -5,6 +5,7 @@
 #include "leds57.h"
 #include "prog57.h"
 #include "rcl57.h"
+#include "save57.h"
 #include "utils57.h"
 
 #endif /* rcl57_Bridging_Header_h */
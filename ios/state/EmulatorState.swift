@@ -19,6 +19,9 @@ class EmulatorState: ObservableObject {
     /// Used to cancel the timer.
     private var timerCancellable: AnyCancellable?
 
+    /// The timestamps of the emulator state at the last update, `nil` before the first update.
+    private var timestamps: ti57_timestamps_t?
+
     
     // MARK: Published Properties.
 
@@ -60,24 +63,36 @@ class EmulatorState: ObservableObject {
                     self.displayString = Rcl57.shared.display
                 }
 
-                for i in 0..<Rcl57.shared.registerCount {
-                    let reg = Rcl57.shared.register(atIndex: i)
-                    if reg != self.registers[i] {
-                        self.registers[i] = reg
-                    }
+                // Skip the registers and the steps if they haven't changed.
+                var changes = ~Int32(0)
+                if let timestamps = self.timestamps {
+                    changes = Rcl57.shared.changes(since: timestamps)
                 }
-                if self.isRegistersAllClear != (Rcl57.shared.registersLastIndex < 0) {
-                    self.isRegistersAllClear = Rcl57.shared.registersLastIndex < 0
+                self.timestamps = Rcl57.shared.timestamps
+
+                if changes & TI57_REGISTERS_CHANGE != 0 {
+                    for i in 0..<Rcl57.shared.registerCount {
+                        let reg = Rcl57.shared.register(atIndex: i)
+                        if reg != self.registers[i] {
+                            self.registers[i] = reg
+                        }
+                    }
+                    if self.isRegistersAllClear != (Rcl57.shared.registersLastIndex < 0) {
+                        self.isRegistersAllClear = Rcl57.shared.registersLastIndex < 0
+                    }
                 }
 
-                for i in 0..<Rcl57.shared.stepCount {
-                    let step = Rcl57.shared.step(atIndex: i, isAlpha: true)
-                    if step != self.steps[i] {
-                        self.steps[i] = step
+                // Steps also depend on the modes, as a step may be edited in LRN mode.
+                if changes & (TI57_PROGRAM_CHANGE | TI57_MODES_CHANGE) != 0 {
+                    for i in 0..<Rcl57.shared.stepCount {
+                        let step = Rcl57.shared.step(atIndex: i, isAlpha: true)
+                        if step != self.steps[i] {
+                            self.steps[i] = step
+                        }
+                    }
+                    if self.isStepsAllClear != (Rcl57.shared.stepsLastIndex < 0) {
+                        self.isStepsAllClear = Rcl57.shared.stepsLastIndex < 0
                     }
-                }
-                if self.isStepsAllClear != (Rcl57.shared.stepsLastIndex < 0) {
-                    self.isStepsAllClear = Rcl57.shared.stepsLastIndex < 0
                 }
 
                 if self.logTimestamp != Log57.shared.logTimestamp {
@@ -142,6 +142,7 @@ void prog57_load_steps_into_memory(prog57_t *program, rcl57_t *rcl57) {
     rcl57->ti57.Y[6][15] = program->state[14][15];
     rcl57->ti57.Y[7][14] = program->state[15][14];
     rcl57->ti57.Y[7][15] = program->state[15][15];
+    ti57_set_changed(&rcl57->ti57, TI57_PROGRAM_CHANGE);
 }
 
 void prog57_load_registers_into_memory(prog57_t *program, rcl57_t *rcl57) {
@@ -153,6 +154,7 @@ void prog57_load_registers_into_memory(prog57_t *program, rcl57_t *rcl57) {
     memcpy(rcl57->ti57.X + 3, program->state +  3, 14 * sizeof(unsigned char));
     memcpy(rcl57->ti57.X + 2, program->state +  2, 14 * sizeof(unsigned char));
     memcpy(rcl57->ti57.X + 4, program->state +  4, 14 * sizeof(unsigned char));
+    ti57_set_changed(&rcl57->ti57, TI57_REGISTERS_CHANGE | TI57_AOS_CHANGE);
 }
 
 char *prog57_get_name(prog57_t *program) {
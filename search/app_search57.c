@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "prog57.h"
+#include "search57.h"
+#include "tab57.h"
+#include "utils57.h"
+
+static double get_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void print_level(int length, long candidate_count, long kept_count, void *arg)
+{
+    double *start = arg;
+    fprintf(stderr, "length %d: %ld candidates, %ld kept, %.2f s\n",
+            length, candidate_count, kept_count, get_time() - *start);
+}
+
+/** Parses "x", "display" or a register "0".."7". Returns -2 if invalid. */
+static int parse_reg(const char *str, int x_value)
+{
+    if (!strcmp(str, "x") || !strcmp(str, "display")) return x_value;
+    if (str[0] >= '0' && str[0] <= '7' && str[1] == 0) return str[0] - '0';
+    return -2;
+}
+
+/** Parses codes in hexadecimal such as "31,56,b0". Returns the number of codes, or -1. */
+static int parse_codes(char *str, unsigned char *codes)
+{
+    int count = 0;
+    char *saveptr;
+
+    for (char *token = strtok_r(str, ",", &saveptr); token; token = strtok_r(NULL, ",", &saveptr)) {
+        char *end;
+        long code = strtol(token, &end, 16);
+        if (*end != 0 || code < 0 || code > 0xff || count == SEARCH57_MAX_CODES) return -1;
+        codes[count++] = (unsigned char)code;
+    }
+    return count;
+}
+
+static int usage(char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-l MAX_LENGTH] [-f] [-r REGISTERS] [-a CODES] [-i x|0..7] "
+            "[-o display|0..7] [-j THREADS] [-c MAX_CYCLES] [-w OUT.r57] INPUT=OUTPUT...\n"
+            "Searches for the shortest program, or the fastest one with -f, that maps each\n"
+            "INPUT stored into X or a register to OUTPUT on the display or in a register.\n"
+            "The steps are made of CODES in hexadecimal (such as 31,56 for x^2 and +) or of\n"
+            "the default ones, with registers 0..REGISTERS-1 (2 by default).\n", name);
+    return 2;
+}
+
+int main(int argc, char **argv)
+{
+    static unsigned char codes[SEARCH57_MAX_CODES];
+    search57_config_t config = {0};
+    int register_count = 2;
+    char *codes_str = NULL, *out_path = NULL;
+    int opt;
+
+    config.input_reg = TAB57_X;
+    config.output_reg = TAB57_DISPLAY;
+    config.max_length = 4;
+    config.thread_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    while ((opt = getopt(argc, argv, "l:fr:a:i:o:j:c:w:")) != -1) {
+        switch (opt) {
+        case 'l': config.max_length = atoi(optarg); break;
+        case 'f': config.is_fastest = true; break;
+        case 'r': register_count = atoi(optarg); break;
+        case 'a': codes_str = optarg; break;
+        case 'i': config.input_reg = parse_reg(optarg, TAB57_X); break;
+        case 'o': config.output_reg = parse_reg(optarg, TAB57_DISPLAY); break;
+        case 'j': config.thread_count = atoi(optarg); break;
+        case 'c': config.max_cycles = strtoul(optarg, NULL, 10); break;
+        case 'w': out_path = optarg; break;
+        default: return usage(argv[0]);
+        }
+    }
+    if (optind == argc || config.input_reg < -1 || config.output_reg < -1 ||
+        config.thread_count < 1 || config.max_length < 1 ||
+        config.max_length > SEARCH57_MAX_LENGTH || register_count < 0 || register_count > 8) {
+        return usage(argv[0]);
+    }
+
+    // The alphabet.
+    config.codes = codes;
+    config.code_count = codes_str ? parse_codes(codes_str, codes)
+                                  : search57_get_default_codes(register_count, codes);
+    if (config.code_count <= 0) {
+        fprintf(stderr, "invalid codes\n");
+        return 2;
+    }
+
+    // The tests.
+    int test_count = argc - optind;
+    search57_test_t *tests = malloc(test_count * sizeof(search57_test_t));
+    for (int i = 0; i < test_count; i++) {
+        char *arg = argv[optind + i];
+        char *equal = strchr(arg + 1, '=');
+        ti57_reg_t reg;
+        if (equal == NULL) return usage(argv[0]);
+        tests[i].input = atof(arg);
+        tests[i].output = atof(equal + 1);
+        if (!utils57_double_to_user_reg(tests[i].input, &reg)) {
+            fprintf(stderr, "%s: input out of range\n", arg);
+            return 2;
+        }
+    }
+    config.tests = tests;
+    config.test_count = test_count;
+
+    // Each candidate starts from a calculator that has just been turned on.
+    static rcl57_t rcl57;
+    rcl57_init(&rcl57);
+    utils57_burst_until_idle(&rcl57.ti57);
+    config.booted = &rcl57;
+
+    double start = get_time();
+    config.on_level = print_level;
+    config.arg = &start;
+    search57_result_t result;
+    if (!search57_run(&config, &result)) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    double elapsed = get_time() - start;
+    fprintf(stderr, "%ld evaluations in %.2f s, %.0f evaluations/s\n",
+            result.evaluation_count, elapsed, result.evaluation_count / elapsed);
+    if (result.is_truncated) {
+        fprintf(stderr, "stopped: too many candidates\n");
+    }
+    if (!result.is_found) {
+        printf("not found\n");
+        return 1;
+    }
+
+    // Print the steps, as in LRN mode.
+    search57_load_steps(&rcl57, result.steps, result.length);
+    printf("%d steps, %lu cycles for %d tests\n", result.length, result.cycle_count, test_count);
+    for (int i = 0; i <= result.length; i++) {
+        op57_t *op = ti57_get_program_op(&rcl57.ti57, i);
+        printf("  %02d %s%s", i, op->inv ? "INV " : "", key57_get_ascii_name(op->key));
+        if (op->d >= 0) {
+            printf(" %d", op->d);
+        }
+        printf("\n");
+    }
+
+    if (out_path) {
+        static prog57_t program;
+        memset(&program, 0, sizeof(program));
+        prog57_set_name(&program, "Search result");
+        prog57_set_steps_from_memory(&program, &rcl57);
+        FILE *file = fopen(out_path, "wb");
+        if (file == NULL || fputs(prog57_to_text(&program), file) < 0 || fclose(file) != 0) {
+            fprintf(stderr, "%s: cannot write\n", out_path);
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,422 @@
+#include "search57.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fork57.h"
+#include "hash57.h"
+#include "tab57.h"
+
+// The code of R/S, which ends every candidate.
+#define CODE_RS 0x17
+
+// The number of candidates a worker evaluates at a time.
+#define CHUNK_SIZE 16
+
+#define MATCH_FLAG    0x01  // The candidate maps every input to its output.
+#define TIMEOUT_FLAG  0x02  // The candidate didn't stop within the budget for some test.
+#define SEEN_FLAG     0x04  // A shorter candidate reached the same states.
+
+// The parts of the state that depend on the steps of the candidates rather than on what they do.
+#define IGNORED (HASH57_IGNORE_STEPS | HASH57_IGNORE_PROGRAM_PC | HASH57_IGNORE_DISPLAY)
+
+typedef struct candidate_s {
+    hash57_t signature;         // The hash of the states of the candidate for all the tests.
+    unsigned int cycle_count;   // The cycles for all the tests.
+    unsigned char flags;
+} candidate_t;
+
+/** What the candidates of all the levels are run from. */
+typedef struct search_s {
+    const search57_config_t *config;
+    tab57_t tab;
+    rcl57_t *started;               // For each test, the state after storing the input and RST.
+    tab57_result_t *start_results;  // For each test, the result of 'tab57_start'.
+    hash57_table_t seen;            // The signatures kept at the previous levels.
+} search_t;
+
+/** The candidates of one length, evaluated by all the workers. */
+typedef struct level_s {
+    const search_t *search;
+    const unsigned char *prefixes;  // The programs kept at the previous level, one after the other.
+    int prefix_length;
+    candidate_t *candidates;        // Prefix i / code_count followed by code i % code_count.
+    long candidate_count;
+    atomic_long next_chunk;
+    atomic_long evaluation_count;
+    atomic_bool is_out_of_memory;
+} level_t;
+
+/** A candidate to sort by signature, then by speed, then by index. */
+typedef struct entry_s {
+    hash57_t signature;
+    unsigned int cycle_count;
+    long index;
+} entry_t;
+
+/** The codes of the default alphabet, except the register operations. */
+static const unsigned char BASE_CODES[] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09,  // Digits
+    0x37, 0x47, 0x23,                                            // . +/- EE
+    0x56, 0x55, 0x54, 0x53, 0x57, 0x33, 0x43, 0x52, 0x5a,        // + - x / = ( ) y^x INV y^x
+    0x31, 0x41, 0x51,                                            // x^2 vx 1/x
+    0x30, 0x38, 0x80, 0x88,                                      // lnx INV lnx log INV log
+    0x81, 0x89, 0x91, 0x99, 0xa1, 0xa9,                          // sin cos tan and INV
+    0xa2, 0xa3, 0x93, 0x9b,                                      // pi |x| Int INV Int
+    0x21,                                                        // x:t
+};
+
+/** The register operations: RCL, STO, SUM, INV SUM, PRD, INV PRD and EXC. */
+static const unsigned char REGISTER_CODES[] = {0xb0, 0xf0, 0xd0, 0xd8, 0xe0, 0xe8, 0xc0};
+
+/** Parses a display such as "-1.25" or "1.25 -12". */
+static double parse_output(const char *str)
+{
+    char *end;
+    double x = strtod(str, &end);
+    long exponent = strtol(end, NULL, 10);
+    return exponent != 0 ? x * pow(10, exponent) : x;
+}
+
+/** Returns whether an output matches the expected one, up to the 8 digits of the display. */
+static bool is_match(const char *str, double expected)
+{
+    return fabs(parse_output(str) - expected) <= 1e-7 * fabs(expected);
+}
+
+/** Runs a program of 'length' steps on all the tests. */
+static void evaluate(const search_t *search, rcl57_t *rcl57, const unsigned char *steps,
+                     int length, candidate_t *candidate)
+{
+    const search57_config_t *config = search->config;
+    tab57_result_t result;
+    hash57_t signature = {0, 0};
+    unsigned long cycle_count = 0;
+    bool is_all_match = true;
+
+    candidate->flags = 0;
+    for (int i = 0; i < config->test_count; i++) {
+        // Only the steps differ from the state started for the test.
+        fork57_copy(rcl57, &search->started[i]);
+        search57_load_steps(rcl57, steps, length);
+        result = search->start_results[i];
+
+        // The state is hashed when the final R/S is fetched: stopping would lose whether an
+        // operation is pending or a number is being entered, which the next step depends on.
+        if (!tab57_run_to_step(&search->tab, rcl57, length, &result)) {
+            candidate->flags = TIMEOUT_FLAG;
+            cycle_count += result.cycle_count;
+            break;
+        }
+        signature = hash57_combine(signature, hash57_state(&rcl57->ti57, IGNORED));
+        tab57_finish(&search->tab, rcl57, &result);
+        cycle_count += result.cycle_count;
+        if (result.status == TAB57_TIMEOUT) {
+            candidate->flags = TIMEOUT_FLAG;
+            break;
+        }
+        is_all_match = is_all_match && result.status == TAB57_OK &&
+                       is_match(result.output, config->tests[i].output);
+    }
+    if (is_all_match && candidate->flags == 0) {
+        candidate->flags = MATCH_FLAG;
+    }
+    if (hash57_table_contains(&search->seen, signature)) {
+        candidate->flags |= SEEN_FLAG;
+    }
+    candidate->signature = signature;
+    candidate->cycle_count = cycle_count > UINT32_MAX ? UINT32_MAX : (unsigned int)cycle_count;
+}
+
+/** Allocates memory for instances of 'rcl57_t', whose fields are aligned on cache lines. */
+static void *alloc_aligned(size_t size)
+{
+    size_t alignment = _Alignof(rcl57_t);
+
+    // The size must be a multiple of the alignment, and not 0 so that NULL means out of memory.
+    if (size == 0) size = 1;
+    return aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+static void *work(void *arg)
+{
+    level_t *level = arg;
+    const search57_config_t *config = level->search->config;
+    rcl57_t *rcl57 = alloc_aligned(sizeof(rcl57_t));
+    unsigned char steps[SEARCH57_MAX_LENGTH];
+    long evaluation_count = 0;
+
+    if (rcl57 == NULL) {
+        atomic_store(&level->is_out_of_memory, true);
+        return NULL;
+    }
+
+    long chunk_count = (level->candidate_count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    for (;;) {
+        long chunk = atomic_fetch_add(&level->next_chunk, 1);
+        if (chunk >= chunk_count) break;
+        long end = (chunk + 1) * CHUNK_SIZE;
+        if (end > level->candidate_count) {
+            end = level->candidate_count;
+        }
+        for (long i = chunk * CHUNK_SIZE; i < end; i++) {
+            long prefix = i / config->code_count;
+            memcpy(steps, level->prefixes + prefix * level->prefix_length, level->prefix_length);
+            steps[level->prefix_length] = config->codes[i % config->code_count];
+            evaluate(level->search, rcl57, steps, level->prefix_length + 1, &level->candidates[i]);
+            evaluation_count += config->test_count;
+        }
+    }
+    atomic_fetch_add(&level->evaluation_count, evaluation_count);
+    free(rcl57);
+    return NULL;
+}
+
+/** Evaluates all the candidates of a level on 'thread_count' threads. */
+static bool evaluate_level(level_t *level)
+{
+    int thread_count = level->search->config->thread_count > 0 ? level->search->config->thread_count
+                                                                : 1;
+    pthread_t *threads = malloc(thread_count * sizeof(pthread_t));
+
+    if (threads == NULL) return false;
+    atomic_init(&level->next_chunk, 0);
+    atomic_init(&level->evaluation_count, 0);
+    atomic_init(&level->is_out_of_memory, false);
+    int started_count = 0;
+    while (started_count < thread_count &&
+           pthread_create(&threads[started_count], NULL, work, level) == 0) {
+        started_count += 1;
+    }
+    if (started_count == 0) {
+        // Evaluate on this thread.
+        work(level);
+    }
+    for (int i = 0; i < started_count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    return !atomic_load(&level->is_out_of_memory);
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+    const entry_t *entry_a = a, *entry_b = b;
+
+    if (entry_a->signature.lo != entry_b->signature.lo) {
+        return entry_a->signature.lo < entry_b->signature.lo ? -1 : 1;
+    }
+    if (entry_a->signature.hi != entry_b->signature.hi) {
+        return entry_a->signature.hi < entry_b->signature.hi ? -1 : 1;
+    }
+    if (entry_a->cycle_count != entry_b->cycle_count) {
+        return entry_a->cycle_count < entry_b->cycle_count ? -1 : 1;
+    }
+    return (entry_a->index > entry_b->index) - (entry_a->index < entry_b->index);
+}
+
+static int compare_indexes(const void *a, const void *b)
+{
+    const entry_t *entry_a = a, *entry_b = b;
+    return (entry_a->index > entry_b->index) - (entry_a->index < entry_b->index);
+}
+
+/**
+ * API IMPLEMENTATION
+ */
+
+int search57_get_default_codes(int register_count, unsigned char *codes)
+{
+    int count = 0;
+
+    for (int i = 0; i < (int)sizeof(BASE_CODES); i++) {
+        codes[count++] = BASE_CODES[i];
+    }
+    for (int i = 0; i < (int)sizeof(REGISTER_CODES); i++) {
+        for (int j = 0; j < register_count && j < 8; j++) {
+            codes[count++] = REGISTER_CODES[i] + j;
+        }
+    }
+    return count;
+}
+
+void search57_load_steps(rcl57_t *rcl57, const unsigned char *steps, int length)
+{
+    for (int i = 0; i < length; i++) {
+        ti57_set_program_step(&rcl57->ti57, i, steps[i]);
+    }
+    ti57_set_program_step(&rcl57->ti57, length, CODE_RS);
+    for (int i = length + 1; i < 50; i++) {
+        ti57_set_program_step(&rcl57->ti57, i, 0);
+    }
+}
+
+bool search57_run(const search57_config_t *config, search57_result_t *result)
+{
+    long max_candidate_count = config->max_candidate_count > 0 ? config->max_candidate_count
+                                                               : SEARCH57_DEFAULT_MAX_CANDIDATES;
+    int max_length = config->max_length < SEARCH57_MAX_LENGTH ? config->max_length
+                                                               : SEARCH57_MAX_LENGTH;
+    unsigned char *prefixes = NULL;   // The programs kept at the previous level.
+    long prefix_count = 1;
+    candidate_t *candidates = NULL;
+    entry_t *entries = NULL;
+    search_t *search = NULL;
+    rcl57_t *rcl57 = NULL;
+    bool ok = false;
+
+    memset(result, 0, sizeof(search57_result_t));
+
+    // Store the input of each test and press RST, once and for all.
+    search = alloc_aligned(sizeof(search_t));
+    if (search == NULL) goto end;
+    search->config = config;
+    search->started = NULL;
+    search->start_results = NULL;
+    if (!hash57_table_init(&search->seen, config->max_table_bytes > 0
+                                              ? config->max_table_bytes
+                                              : SEARCH57_DEFAULT_TABLE_BYTES)) {
+        free(search);
+        search = NULL;
+        goto end;
+    }
+    tab57_init(&search->tab, config->booted, config->input_reg, config->output_reg,
+               config->max_cycles > 0 ? config->max_cycles : SEARCH57_DEFAULT_MAX_CYCLES);
+    search->started = alloc_aligned(config->test_count * sizeof(rcl57_t));
+    search->start_results = malloc(config->test_count * sizeof(tab57_result_t));
+    rcl57 = alloc_aligned(sizeof(rcl57_t));
+    prefixes = malloc(1);
+    if (search->started == NULL || search->start_results == NULL || rcl57 == NULL ||
+        prefixes == NULL) {
+        goto end;
+    }
+    for (int i = 0; i < config->test_count; i++) {
+        if (!tab57_start(&search->tab, &search->started[i], config->tests[i].input,
+                         &search->start_results[i])) {
+            // No program can map this input.
+            ok = true;
+            goto end;
+        }
+    }
+
+    // The empty program.
+    candidate_t candidate;
+    evaluate(search, rcl57, NULL, 0, &candidate);
+    result->evaluation_count += config->test_count;
+    if (candidate.flags & MATCH_FLAG) {
+        result->is_found = true;
+        result->cycle_count = candidate.cycle_count;
+        if (!config->is_fastest) {
+            ok = true;
+            goto end;
+        }
+    }
+    hash57_table_insert(&search->seen, candidate.signature);
+
+    for (int length = 1; length <= max_length; length++) {
+        level_t level = {0};
+        level.search = search;
+        level.prefixes = prefixes;
+        level.prefix_length = length - 1;
+        level.candidate_count = prefix_count * config->code_count;
+        if (level.candidate_count > max_candidate_count) {
+            result->is_truncated = true;
+            break;
+        }
+        candidates = malloc(level.candidate_count * sizeof(candidate_t));
+        if (candidates == NULL) goto end;
+        level.candidates = candidates;
+        if (!evaluate_level(&level)) goto end;
+        result->evaluation_count += atomic_load(&level.evaluation_count);
+
+        // The fastest match, the first one if several are as fast.
+        long best = -1;
+        for (long i = 0; i < level.candidate_count; i++) {
+            if ((candidates[i].flags & MATCH_FLAG) &&
+                (best < 0 || candidates[i].cycle_count < candidates[best].cycle_count)) {
+                best = i;
+            }
+        }
+        if (best >= 0 &&
+            (!result->is_found || candidates[best].cycle_count < result->cycle_count)) {
+            result->is_found = true;
+            memcpy(result->steps, prefixes + (best / config->code_count) * level.prefix_length,
+                   level.prefix_length);
+            result->steps[level.prefix_length] = config->codes[best % config->code_count];
+            result->length = length;
+            result->cycle_count = candidates[best].cycle_count;
+        }
+        if ((result->is_found && !config->is_fastest) || length == max_length) {
+            if (config->on_level) {
+                config->on_level(length, level.candidate_count, 0, config->arg);
+            }
+            break;
+        }
+
+        // Keep the fastest candidate of each new signature.
+        entries = malloc(level.candidate_count * sizeof(entry_t));
+        if (entries == NULL) goto end;
+        long entry_count = 0;
+        for (long i = 0; i < level.candidate_count; i++) {
+            candidate_t *candidate = &candidates[i];
+            if (candidate->flags != 0) continue;
+            if (result->is_found && candidate->cycle_count >= result->cycle_count) continue;
+            entries[entry_count++] = (entry_t){candidate->signature, candidate->cycle_count, i};
+        }
+        qsort(entries, entry_count, sizeof(entry_t), compare_entries);
+        long kept_count = 0;
+        for (long i = 0; i < entry_count; i++) {
+            if (i == 0 || !hash57_equals(entries[i].signature, entries[i - 1].signature)) {
+                entries[kept_count++] = entries[i];
+            }
+        }
+
+        // Once the table is full, the candidates are no longer compared to the shorter ones.
+        for (long i = 0; i < kept_count; i++) {
+            hash57_table_insert(&search->seen, entries[i].signature);
+        }
+
+        // The programs to extend at the next level, in the order of the enumeration.
+        qsort(entries, kept_count, sizeof(entry_t), compare_indexes);
+        unsigned char *new_prefixes = malloc(kept_count * length + 1);
+        if (new_prefixes == NULL) goto end;
+        for (long i = 0; i < kept_count; i++) {
+            long index = entries[i].index;
+            memcpy(new_prefixes + i * length,
+                   prefixes + (index / config->code_count) * level.prefix_length,
+                   level.prefix_length);
+            new_prefixes[i * length + level.prefix_length] =
+                config->codes[index % config->code_count];
+        }
+        free(prefixes);
+        prefixes = new_prefixes;
+        prefix_count = kept_count;
+        free(entries);
+        entries = NULL;
+        free(candidates);
+        candidates = NULL;
+
+        if (config->on_level) {
+            config->on_level(length, level.candidate_count, kept_count, config->arg);
+        }
+        if (kept_count == 0) break;
+    }
+    ok = true;
+
+end:
+    if (search != NULL) {
+        free(search->started);
+        free(search->start_results);
+        hash57_table_destroy(&search->seen);
+    }
+    free(search);
+    free(rcl57);
+    free(prefixes);
+    free(candidates);
+    free(entries);
+    return ok;
+}
@@ -0,0 +1,94 @@
+/**
+ * Searching for the shortest (or fastest) program that maps given inputs to given outputs.
+ *
+ * Candidate programs are straight-line sequences of steps, given by their codes in 'Y' (see
+ * 'ti57_set_program_step'), followed by R/S. They are enumerated by length: each program of
+ * length n + 1 is a program of length n kept at the previous level followed by one of the codes
+ * of the alphabet. Each candidate is run with tab57.h on every test, within a strict cycle budget.
+ *
+ * Candidates are pruned by the state they leave the calculator in: the state is hashed for each
+ * test when the final R/S is fetched, and of all the candidates of a level that reach the same
+ * states on all the tests, only the fastest one is extended. A candidate that reaches the same
+ * states as a shorter one is not extended either, as long as the table of the states seen so far
+ * (see hash57.h) has room. The candidates of a level are evaluated by a pool
+ * of threads, and the result doesn't depend on the number of threads.
+ */
+
+#ifndef search57_h
+#define search57_h
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "rcl57.h"
+
+/** The maximum length of a program, not counting the final R/S. */
+#define SEARCH57_MAX_LENGTH 16
+
+/** The maximum number of codes in an alphabet. */
+#define SEARCH57_MAX_CODES 256
+
+/** The default of 'max_cycles': far more than any straight-line program of 16 steps needs. */
+#define SEARCH57_DEFAULT_MAX_CYCLES 200000
+
+/** The default of 'max_candidate_count'. Each candidate takes 56 bytes during a level. */
+#define SEARCH57_DEFAULT_MAX_CANDIDATES 16000000
+
+/** The default of 'max_table_bytes'. */
+#define SEARCH57_DEFAULT_TABLE_BYTES (64 << 20)
+
+typedef struct search57_test_s {
+    double input;
+    double output;
+} search57_test_t;
+
+typedef struct search57_config_s {
+    const rcl57_t *booted;         // The state to run each candidate from, waiting for a key.
+    int input_reg;                 // TAB57_X or a user register (0..7).
+    int output_reg;                // TAB57_DISPLAY or a user register (0..7).
+    const search57_test_t *tests;
+    int test_count;
+    const unsigned char *codes;    // The alphabet of the steps.
+    int code_count;
+    int max_length;                // The longest program to try.
+    bool is_fastest;               // Whether to look for the fastest program up to 'max_length'.
+    unsigned long max_cycles;      // The longest run of a candidate for a test. 0 for the default.
+    long max_candidate_count;      // The most candidates of a level. 0 for the default.
+    size_t max_table_bytes;        // The memory for the states seen so far. 0 for the default.
+    int thread_count;
+
+    // Called, if not NULL, after each level.
+    void (*on_level)(int length, long candidate_count, long kept_count, void *arg);
+    void *arg;
+} search57_config_t;
+
+typedef struct search57_result_s {
+    bool is_found;
+    unsigned char steps[SEARCH57_MAX_LENGTH];  // The codes of the program found.
+    int length;
+    unsigned long cycle_count;                 // The cycles of the program for all the tests.
+    long evaluation_count;                     // The runs of candidates for a test.
+    bool is_truncated;                         // Whether a level had too many candidates.
+} search57_result_t;
+
+/**
+ * Returns the number of codes of the default alphabet, and stores them into 'codes'.
+ *
+ * The default alphabet has the steps with no side effects on the flow or the display: digits and
+ * number entry, arithmetic, parentheses, functions, x:t, and the register operations on registers
+ * 0..register_count - 1.
+ */
+int search57_get_default_codes(int register_count, unsigned char *codes);
+
+/**
+ * Searches for the shortest program, or the fastest one if 'is_fastest', that maps each test input
+ * to the test output, up to the 8 significant digits of the display.
+ *
+ * Returns false if out of memory.
+ */
+bool search57_run(const search57_config_t *config, search57_result_t *result);
+
+/** Loads 'length' steps followed by R/S into 'rcl57', and clears the other steps. */
+void search57_load_steps(rcl57_t *rcl57, const unsigned char *steps, int length);
+
+#endif  /* !search57_h */
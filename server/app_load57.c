@@ -0,0 +1,189 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+// The keys of each round: "12 + 34 = CLR".
+static int ROUND_KEYS[] = {72, 73, 75, 74, 62, 85, 15};
+
+typedef struct client_s {
+    const char *path;
+    int pipeline;            // The number of key rounds sent at once.
+    double seconds;
+    long request_count;
+    long batch_count;
+    double batch_seconds;    // The total time between sending a batch and receiving its responses.
+    bool is_failed;
+} client_t;
+
+static double get_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** A buffered reader of responses. */
+typedef struct reader_s {
+    int fd;
+    char buf[65536];
+    int start;
+    int end;
+} reader_t;
+
+/** Reads one response into 'line', skipping its payload. Returns false on error. */
+static bool read_response(reader_t *reader, char *line, int size)
+{
+    int skip = -1;  // The size of the payload to skip, once the line has been read.
+
+    for (;;) {
+        if (skip < 0) {
+            char *newline = memchr(reader->buf + reader->start, '\n', reader->end - reader->start);
+            if (newline) {
+                int length = (int)(newline - (reader->buf + reader->start));
+                snprintf(line, size, "%.*s", length, reader->buf + reader->start);
+                reader->start += length + 1;
+                char *plus = strrchr(line, '+');
+                skip = plus && plus[-1] == ' ' ? atoi(plus + 1) : 0;
+                continue;
+            }
+        } else {
+            int n = reader->end - reader->start < skip ? reader->end - reader->start : skip;
+            reader->start += n;
+            skip -= n;
+            if (skip == 0) return true;
+        }
+        if (reader->start == reader->end) {
+            reader->start = reader->end = 0;
+        } else if (reader->end == (int)sizeof(reader->buf)) {
+            memmove(reader->buf, reader->buf + reader->start, reader->end - reader->start);
+            reader->end -= reader->start;
+            reader->start = 0;
+        }
+        ssize_t n = read(reader->fd, reader->buf + reader->end, sizeof(reader->buf) - reader->end);
+        if (n <= 0) return false;
+        reader->end += (int)n;
+    }
+}
+
+static bool write_all(int fd, const char *data, int size)
+{
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n <= 0) return false;
+        data += n;
+        size -= (int)n;
+    }
+    return true;
+}
+
+static void *run_client(void *arg)
+{
+    client_t *client = arg;
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, client->path, sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        client->is_failed = true;
+        return NULL;
+    }
+    reader_t *reader = calloc(1, sizeof(reader_t));
+    reader->fd = fd;
+
+    char line[512];
+    int id;
+    if (!write_all(fd, "new\n", 4) || !read_response(reader, line, sizeof(line)) ||
+        sscanf(line, "ok %d", &id) != 1) {
+        client->is_failed = true;
+        return NULL;
+    }
+
+    // Each key is pressed, run, released and run, then the display is read.
+    int key_count = sizeof(ROUND_KEYS) / sizeof(ROUND_KEYS[0]);
+    char *batch = malloc(client->pipeline * key_count * 128);
+    int size = 0;
+    for (int i = 0; i < client->pipeline; i++) {
+        for (int k = 0; k < key_count; k++) {
+            size += sprintf(batch + size, "press %d %d\nrun %d\nrelease %d\nrun %d\ndisplay %d\n",
+                            id, ROUND_KEYS[k], id, id, id, id);
+        }
+    }
+    int batch_request_count = client->pipeline * key_count * 5;
+
+    double end = get_time() + client->seconds;
+    while (get_time() < end) {
+        double start = get_time();
+        if (!write_all(fd, batch, size)) {
+            client->is_failed = true;
+            break;
+        }
+        for (int i = 0; i < batch_request_count; i++) {
+            if (!read_response(reader, line, sizeof(line)) || strncmp(line, "ok", 2)) {
+                client->is_failed = true;
+                break;
+            }
+        }
+        if (client->is_failed) break;
+        client->request_count += batch_request_count;
+        client->batch_count += 1;
+        client->batch_seconds += get_time() - start;
+    }
+
+    free(batch);
+    free(reader);
+    close(fd);
+    return NULL;
+}
+
+/** Measures the requests per second of a session server. See server57.h for the protocol. */
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s SOCKET [CONNECTIONS] [SECONDS] [PIPELINE]\n", argv[0]);
+        return 2;
+    }
+    int conn_count = argc > 2 ? atoi(argv[2]) : 4;
+    double seconds = argc > 3 ? atof(argv[3]) : 5;
+    int pipeline = argc > 4 ? atoi(argv[4]) : 1;
+    if (conn_count < 1 || pipeline < 1) {
+        fprintf(stderr, "invalid arguments\n");
+        return 2;
+    }
+
+    client_t *clients = calloc(conn_count, sizeof(client_t));
+    pthread_t *threads = calloc(conn_count, sizeof(pthread_t));
+    double start = get_time();
+    for (int i = 0; i < conn_count; i++) {
+        clients[i] = (client_t){argv[1], pipeline, seconds, 0, 0, 0, false};
+        pthread_create(&threads[i], NULL, run_client, &clients[i]);
+    }
+
+    long request_count = 0, batch_count = 0, failed_count = 0;
+    double batch_seconds = 0;
+    for (int i = 0; i < conn_count; i++) {
+        pthread_join(threads[i], NULL);
+        request_count += clients[i].request_count;
+        batch_count += clients[i].batch_count;
+        batch_seconds += clients[i].batch_seconds;
+        failed_count += clients[i].is_failed;
+    }
+    double elapsed = get_time() - start;
+
+    printf("%d connections, %d rounds per batch: %ld requests in %.2f s, %.0f requests/s\n",
+           conn_count, pipeline, request_count, elapsed, request_count / elapsed);
+    if (batch_count > 0) {
+        printf("mean batch round trip %.3f ms\n", batch_seconds / batch_count * 1000);
+    }
+    if (failed_count > 0) {
+        printf("%ld connections failed\n", failed_count);
+    }
+    return failed_count > 0;
+}
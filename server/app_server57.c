@@ -0,0 +1,190 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "server57.h"
+
+// The maximum number of connections and sessions per worker.
+#define MAX_CONN_COUNT 1024
+#define MAX_SESSION_COUNT 4096
+
+// Stop reading from a connection while this many bytes of responses are waiting.
+#define MAX_PENDING_OUT 1048576
+
+typedef struct worker_s {
+    int listen_fd;
+    server57_pool_t pool;
+    struct pollfd fds[MAX_CONN_COUNT + 1];  // The listening socket first.
+    server57_conn_t *conns[MAX_CONN_COUNT + 1];  // Allocated, as the sessions refer to them.
+    int count;
+} worker_t;
+
+static void set_nonblocking(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+static void close_conn(worker_t *worker, int i)
+{
+    close(worker->fds[i].fd);
+    server57_conn_destroy(worker->conns[i]);
+    free(worker->conns[i]);
+    worker->count -= 1;
+    worker->fds[i] = worker->fds[worker->count];
+    worker->conns[i] = worker->conns[worker->count];
+}
+
+static void accept_conns(worker_t *worker)
+{
+    while (worker->count < MAX_CONN_COUNT + 1) {
+        int fd = accept(worker->listen_fd, NULL, NULL);
+        if (fd < 0) return;  // Most likely taken by another worker.
+        server57_conn_t *conn = malloc(sizeof(server57_conn_t));
+        if (conn == NULL) {
+            close(fd);
+            return;
+        }
+        set_nonblocking(fd);
+        server57_conn_init(conn, &worker->pool);
+        worker->fds[worker->count] = (struct pollfd){fd, POLLIN, 0};
+        worker->conns[worker->count] = conn;
+        worker->count += 1;
+    }
+}
+
+/** Sends the waiting responses. Returns false if the connection should be closed. */
+static bool flush_conn(worker_t *worker, int i)
+{
+    server57_conn_t *conn = worker->conns[i];
+
+    while (conn->out_count > 0) {
+        ssize_t n = write(worker->fds[i].fd, conn->out, conn->out_count);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            if (errno == EINTR) continue;
+            return false;
+        }
+        server57_conn_sent(conn, (int)n);
+    }
+    worker->fds[i].events = (conn->out_count < MAX_PENDING_OUT ? POLLIN : 0) |
+                            (conn->out_count > 0 ? POLLOUT : 0);
+    return true;
+}
+
+/** Executes the requests received. Returns false if the connection should be closed. */
+static bool read_conn(worker_t *worker, int i)
+{
+    static _Thread_local unsigned char buf[65536];
+
+    for (;;) {
+        ssize_t n = read(worker->fds[i].fd, buf, sizeof(buf));
+        if (n == 0) return false;
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (!server57_conn_receive(worker->conns[i], buf, (int)n)) return false;
+        if (n < (ssize_t)sizeof(buf)) return true;
+    }
+}
+
+static void *work(void *arg)
+{
+    worker_t *worker = arg;
+
+    worker->fds[0] = (struct pollfd){worker->listen_fd, POLLIN, 0};
+    worker->count = 1;
+    for (;;) {
+        if (poll(worker->fds, worker->count, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            exit(1);
+        }
+        if (worker->fds[0].revents & POLLIN) {
+            accept_conns(worker);
+        }
+        // Go backwards, so that closing a connection doesn't skip another one.
+        for (int i = worker->count - 1; i > 0; i--) {
+            short revents = worker->fds[i].revents;
+            worker->fds[i].revents = 0;
+            if (revents == 0) continue;
+            bool ok = !(revents & (POLLERR | POLLNVAL));
+            if (ok && (revents & (POLLIN | POLLHUP))) {
+                ok = read_conn(worker, i);
+            }
+            if (ok) {
+                // All the responses to the requests received at once are sent together.
+                ok = flush_conn(worker, i);
+            }
+            if (!ok) {
+                close_conn(worker, i);
+            }
+        }
+        worker->fds[0].events = worker->count < MAX_CONN_COUNT + 1 ? POLLIN : 0;
+    }
+    return NULL;
+}
+
+/**
+ * Serves sessions on a Unix domain socket, with one thread per CPU by default. See server57.h for
+ * the protocol.
+ */
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s SOCKET [WORKERS]\n", argv[0]);
+        return 2;
+    }
+    int worker_count = argc > 2 ? atoi(argv[2]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (worker_count < 1) {
+        worker_count = 1;
+    }
+
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    if (strlen(argv[1]) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "%s: socket path too long\n", argv[1]);
+        return 1;
+    }
+    strcpy(addr.sun_path, argv[1]);
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(argv[1]);
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(listen_fd, SOMAXCONN) < 0) {
+        perror(argv[1]);
+        return 1;
+    }
+    set_nonblocking(listen_fd);
+    signal(SIGPIPE, SIG_IGN);
+
+    // Each worker accepts its own connections, and runs their sessions.
+    pthread_t threads[worker_count];
+    for (int i = 0; i < worker_count; i++) {
+        worker_t *worker = calloc(1, sizeof(worker_t));
+        if (worker == NULL || !server57_pool_init(&worker->pool, MAX_SESSION_COUNT)) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+        worker->listen_fd = listen_fd;
+        if (pthread_create(&threads[i], NULL, work, worker) != 0) {
+            perror("pthread_create");
+            return 1;
+        }
+    }
+    printf("serving on %s with %d workers\n", argv[1], worker_count);
+    fflush(stdout);
+    for (int i = 0; i < worker_count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    return 0;
+}
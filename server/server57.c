@@ -0,0 +1,505 @@
+#include "server57.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "prog57.h"
+#include "save57.h"
+#include "utils57.h"
+
+// The maximum number of tokens in a request.
+#define MAX_TOKENS 8
+
+// The default limit of 'run', in ms of emulated time.
+#define DEFAULT_RUN_MS 60000
+
+// 'run' checks whether the calculator is idle every RUN_CHUNK_MS ms of emulated time.
+#define RUN_CHUNK_MS 20
+
+/**
+ * POOL
+ */
+
+bool server57_pool_init(server57_pool_t *pool, int capacity)
+{
+    memset(pool, 0, sizeof(server57_pool_t));
+    if (!arena57_init(&pool->arena, capacity)) return false;
+    pool->owners = calloc(pool->arena.capacity, sizeof(void *));
+    pool->free_indexes = malloc(pool->arena.capacity * sizeof(int));
+    if (pool->owners == NULL || pool->free_indexes == NULL) {
+        server57_pool_destroy(pool);
+        return false;
+    }
+    return true;
+}
+
+void server57_pool_destroy(server57_pool_t *pool)
+{
+    arena57_destroy(&pool->arena);
+    free(pool->owners);
+    free(pool->free_indexes);
+    memset(pool, 0, sizeof(server57_pool_t));
+}
+
+/** Returns the index of a new session, or -1 if the pool is full. */
+static int alloc_session(server57_pool_t *pool, void *owner)
+{
+    int index;
+
+    if (pool->free_count > 0) {
+        index = pool->free_indexes[--pool->free_count];
+        rcl57_init(arena57_get(&pool->arena, index));
+    } else if (arena57_alloc(&pool->arena) != NULL) {
+        index = pool->arena.count - 1;
+    } else {
+        return -1;
+    }
+    pool->owners[index] = owner;
+    return index;
+}
+
+static void free_session(server57_pool_t *pool, int index)
+{
+    pool->owners[index] = NULL;
+    pool->free_indexes[pool->free_count++] = index;
+}
+
+/**
+ * RESPONSES
+ */
+
+/** Makes room for 'size' more bytes in 'out'. */
+static bool reserve(server57_conn_t *conn, int size)
+{
+    if (conn->out_count + size <= conn->out_capacity) return true;
+
+    int capacity = conn->out_capacity > 0 ? conn->out_capacity : 4096;
+    while (capacity < conn->out_count + size) {
+        capacity *= 2;
+    }
+    unsigned char *out = realloc(conn->out, capacity);
+    if (out == NULL) return false;
+    conn->out = out;
+    conn->out_capacity = capacity;
+    return true;
+}
+
+static bool reply(server57_conn_t *conn, const char *format, ...)
+{
+    char line[SERVER57_MAX_LINE + 16];
+    va_list args;
+
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line) - 1, format, args);
+    va_end(args);
+    if (length > (int)sizeof(line) - 2) {
+        length = sizeof(line) - 2;
+    }
+    line[length++] = '\n';
+
+    if (!reserve(conn, length)) return false;
+    memcpy(conn->out + conn->out_count, line, length);
+    conn->out_count += length;
+    return true;
+}
+
+static bool reply_payload(server57_conn_t *conn, const void *payload, int size)
+{
+    if (!reply(conn, "ok +%d", size) || !reserve(conn, size)) return false;
+    memcpy(conn->out + conn->out_count, payload, size);
+    conn->out_count += size;
+    return true;
+}
+
+/**
+ * REQUESTS
+ */
+
+typedef struct request_s {
+    int argc;
+    char *argv[MAX_TOKENS];
+    const unsigned char *payload;
+    int payload_size;
+} request_t;
+
+/** Returns the session in the first argument, if it belongs to the connection. */
+static rcl57_t *get_session(server57_conn_t *conn, request_t *request)
+{
+    if (request->argc < 2) return NULL;
+
+    char *end;
+    long index = strtol(request->argv[1], &end, 10);
+    if (*end || index < 0 || index >= conn->pool->arena.count ||
+        conn->pool->owners[index] != conn) {
+        return NULL;
+    }
+    return arena57_get(&conn->pool->arena, (int)index);
+}
+
+/** Whether the calculator waits for a key event, possibly while blinking. */
+static bool is_idle(rcl57_t *rcl57)
+{
+    return rcl57_get_wakeup_ms(rcl57) == RCL57_WAKEUP_NEVER ||
+           rcl57->ti57.activity == TI57_POLL_PRESS_BLINK;
+}
+
+/** Runs until the calculator is idle, for up to 'ms'. Returns whether it is idle. */
+static bool run(rcl57_t *rcl57, long ms)
+{
+    for (long t = 0; t < ms && !is_idle(rcl57); t += RUN_CHUNK_MS) {
+        rcl57_advance(rcl57, RUN_CHUNK_MS);
+    }
+    return is_idle(rcl57);
+}
+
+static bool do_new(server57_conn_t *conn, request_t *request)
+{
+    int index = alloc_session(conn->pool, conn);
+    if (index < 0) return reply(conn, "err too many sessions");
+
+    rcl57_t *rcl57 = arena57_get(&conn->pool->arena, index);
+    if (request->argc > 1) {
+        rcl57->options = atoi(request->argv[1]);
+    }
+    run(rcl57, DEFAULT_RUN_MS);
+    return reply(conn, "ok %d", index);
+}
+
+static bool do_free(server57_conn_t *conn, request_t *request)
+{
+    rcl57_t *rcl57 = get_session(conn, request);
+    if (rcl57 == NULL) return reply(conn, "err unknown session");
+
+    free_session(conn->pool, atoi(request->argv[1]));
+    return reply(conn, "ok");
+}
+
+static bool do_load(server57_conn_t *conn, request_t *request)
+{
+    rcl57_t *rcl57 = get_session(conn, request);
+    if (rcl57 == NULL) return reply(conn, "err unknown session");
+
+    static _Thread_local prog57_t program;
+    static _Thread_local char text[SERVER57_MAX_PAYLOAD + 1];
+    memcpy(text, request->payload, request->payload_size);
+    text[request->payload_size] = 0;
+    if (!prog57_from_text(&program, text)) return reply(conn, "err invalid program");
+
+    prog57_load_steps_into_memory(&program, rcl57);
+    prog57_load_registers_into_memory(&program, rcl57);
+    return reply(conn, "ok %s", prog57_get_name(&program));
+}
+
+static bool do_press(server57_conn_t *conn, request_t *request)
+{
+    rcl57_t *rcl57 = get_session(conn, request);
+    if (rcl57 == NULL) return reply(conn, "err unknown session");
+
+    int key = request->argc > 2 ? atoi(request->argv[2]) : 0;
+    if (key / 10 < 1 || key / 10 > 8 || key % 10 < 1 || key % 10 > 5) {
+        return reply(conn, "err invalid key");
+    }
+    rcl57_key_press(rcl57, key / 10, key % 10);
+    return reply(conn, "ok");
+}
+
+static bool do_release(server57_conn_t *conn, request_t *request)
+{
+    rcl57_t *rcl57 = get_session(conn, request);
+    if (rcl57 == NULL) return reply(conn, "err unknown session");
+
+    rcl57_key_release(rcl57);
+    return reply(conn, "ok");
+}
+
+static bool do_run(server57_conn_t *conn, request_t *request)
+{
+    rcl57_t *rcl57 = get_session(conn, request);
+    if (rcl57 == NULL) return reply(conn, "err unknown session");
+
+    long ms = request->argc > 2 ? atol(request->argv[2]) : DEFAULT_RUN_MS;
+    unsigned long start_cycle = rcl57->ti57.current_cycle;
+    bool idle = run(rcl57, ms);
+    return reply(conn, "ok %lu %s", rcl57->ti57.current_cycle - start_cycle,
+                 idle ? "idle" : "busy");
+}
+
+static bool do_display(server57_conn_t *conn, request_t *request)
+{
+    rcl57_t *rcl57 = get_session(conn, request);
+    if (rcl57 == NULL) return reply(conn, "err unknown session");
+
+    return reply(conn, "ok %s", rcl57_get_display(rcl57));
+}
+
+static bool do_regs(server57_conn_t *conn, request_t *request)
+{
+    rcl57_t *rcl57 = get_session(conn, request);
+    if (rcl57 == NULL) return reply(conn, "err unknown session");
+
+    ti57_t *ti57 = &rcl57->ti57;
+    char line[SERVER57_MAX_LINE] = "ok";
+    for (int i = 0; i < 8; i++) {
+        char *reg = utils57_user_reg_to_str(ti57_get_user_reg(ti57, i), ti57_is_sci(ti57),
+                                            ti57_get_fix(ti57));
+        strcat(line, " ");
+        strcat(line, utils57_trim(reg));
+    }
+    return reply(conn, "%s", line);
+}
+
+static bool do_log(server57_conn_t *conn, request_t *request)
+{
+    rcl57_t *rcl57 = get_session(conn, request);
+    if (rcl57 == NULL) return reply(conn, "err unknown session");
+
+    log57_t *log = &rcl57->ti57.log;
+    long last = log57_get_logged_count(log);
+    long count = request->argc > 2 ? atol(request->argv[2]) : LOG57_MAX_ENTRY_COUNT;
+    if (count > LOG57_MAX_ENTRY_COUNT) {
+        count = LOG57_MAX_ENTRY_COUNT;
+    }
+    long first = last - count + 1 > 1 ? last - count + 1 : 1;
+
+    static _Thread_local char text[LOG57_MAX_ENTRY_COUNT * 40];
+    int size = 0;
+    for (long i = first; i <= last; i++) {
+        log57_entry_t *entry = log57_get_entry(log, i);
+        size += sprintf(text + size, "%ld %d %s\n", i, entry->type, entry->message);
+    }
+    return reply_payload(conn, text, size);
+}
+
+static bool do_snapshot(server57_conn_t *conn, request_t *request)
+{
+    rcl57_t *rcl57 = get_session(conn, request);
+    if (rcl57 == NULL) return reply(conn, "err unknown session");
+
+    static _Thread_local unsigned char buf[SAVE57_MAX_SIZE];
+    int flags = request->argc > 2 && !strcmp(request->argv[2], "log") ? SAVE57_LOG_FLAG : 0;
+    int size = save57_write(rcl57, buf, sizeof(buf), flags);
+    if (size == 0) return reply(conn, "err cannot save");
+    return reply_payload(conn, buf, size);
+}
+
+static bool do_restore(server57_conn_t *conn, request_t *request)
+{
+    rcl57_t *rcl57 = get_session(conn, request);
+    if (rcl57 == NULL) return reply(conn, "err unknown session");
+
+    if (!save57_read(rcl57, request->payload, request->payload_size)) {
+        return reply(conn, "err invalid state");
+    }
+    return reply(conn, "ok");
+}
+
+static const struct {
+    const char *name;
+    bool (*execute)(server57_conn_t *conn, request_t *request);
+} COMMANDS[] = {
+    {"new", do_new},
+    {"free", do_free},
+    {"load", do_load},
+    {"press", do_press},
+    {"release", do_release},
+    {"run", do_run},
+    {"display", do_display},
+    {"regs", do_regs},
+    {"log", do_log},
+    {"snapshot", do_snapshot},
+    {"restore", do_restore},
+};
+
+static bool execute(server57_conn_t *conn, request_t *request)
+{
+    if (request->argc == 0) return reply(conn, "err empty request");
+
+    for (int i = 0; i < (int)(sizeof(COMMANDS) / sizeof(COMMANDS[0])); i++) {
+        if (!strcmp(request->argv[0], COMMANDS[i].name)) {
+            return COMMANDS[i].execute(conn, request);
+        }
+    }
+    return reply(conn, "err unknown command");
+}
+
+/**
+ * Returns the size of the payload announced by the last token of 'line', if it is "+N", 0 if there
+ * is none, or -1 if the size is invalid. If 'is_cut', 'line' is the end of a longer line, and a
+ * token at its start may be the end of a longer one: it is ignored.
+ */
+static int get_payload_size(const char *line, int length, bool is_cut)
+{
+    int end = length;
+
+    while (end > 0 && (line[end - 1] == ' ' || line[end - 1] == '\r')) end--;
+    int start = end;
+    while (start > 0 && line[start - 1] != ' ' && line[start - 1] != '\r') start--;
+    if (start == end || line[start] != '+' || (is_cut && start == 0)) return 0;
+
+    int payload_size = atoi(line + start + 1);
+    return payload_size < 0 || payload_size > SERVER57_MAX_PAYLOAD ? -1 : payload_size;
+}
+
+/** Keeps the end of a line too long, up to SERVER57_SKIPPED_TAIL bytes, as it is skipped. */
+static void keep_skipped_tail(server57_conn_t *conn, const unsigned char *data, int size)
+{
+    int keep = size < SERVER57_SKIPPED_TAIL ? SERVER57_SKIPPED_TAIL - size : 0;
+
+    if (keep > conn->skipped_tail_length) {
+        keep = conn->skipped_tail_length;
+    }
+    if (keep < conn->skipped_tail_length || size > SERVER57_SKIPPED_TAIL) {
+        conn->is_tail_cut = true;
+    }
+    if (size > SERVER57_SKIPPED_TAIL) {
+        data += size - SERVER57_SKIPPED_TAIL;
+        size = SERVER57_SKIPPED_TAIL;
+    }
+    memmove(conn->skipped_tail, conn->skipped_tail + conn->skipped_tail_length - keep, keep);
+    memcpy(conn->skipped_tail + keep, data, size);
+    conn->skipped_tail_length = keep + size;
+}
+
+/**
+ * Executes the request at the start of 'data', if complete.
+ *
+ * Returns the size of the request, 0 if it is incomplete, or -1 if the connection should be
+ * closed.
+ */
+static int execute_next(server57_conn_t *conn, const unsigned char *data, int size)
+{
+    // Skip the payload of a line that was too long, as it arrives.
+    if (conn->payload_skip_count > 0) {
+        int skipped = size < conn->payload_skip_count ? size : conn->payload_skip_count;
+        conn->payload_skip_count -= skipped;
+        return skipped;
+    }
+
+    const unsigned char *newline = memchr(data, '\n', size);
+
+    if (newline == NULL) {
+        // Skip the lines that are too long, and reply once they are complete.
+        if (size > SERVER57_MAX_LINE) {
+            keep_skipped_tail(conn, data, size);
+            conn->is_skipping = true;
+            return size;
+        }
+        return 0;
+    }
+
+    int line_size = (int)(newline - data) + 1;
+    if (conn->is_skipping || line_size > SERVER57_MAX_LINE) {
+        // The end of the line tells the size of the payload to skip next.
+        keep_skipped_tail(conn, data, line_size - 1);
+        int payload_size = get_payload_size(conn->skipped_tail, conn->skipped_tail_length,
+                                            conn->is_tail_cut);
+        conn->is_skipping = false;
+        conn->skipped_tail_length = 0;
+        conn->is_tail_cut = false;
+        if (payload_size < 0) return -1;
+        conn->payload_skip_count = payload_size;
+        return reply(conn, "err line too long") ? line_size : -1;
+    }
+
+    char line[SERVER57_MAX_LINE + 1];
+    memcpy(line, data, line_size - 1);
+    line[line_size - 1] = 0;
+
+    // The payload, if any, follows the line. It is skipped along with the line on errors.
+    int payload_size = get_payload_size(line, line_size - 1, false);
+    if (payload_size < 0) return -1;
+    if (size < line_size + payload_size) return 0;
+    int request_size = line_size + payload_size;
+
+    request_t request = {0};
+    char *state;
+    for (char *token = strtok_r(line, " \r", &state); token;
+         token = strtok_r(NULL, " \r", &state)) {
+        if (request.argc == MAX_TOKENS) {
+            return reply(conn, "err too many arguments") ? request_size : -1;
+        }
+        request.argv[request.argc++] = token;
+    }
+    if (request.argc > 0 && request.argv[request.argc - 1][0] == '+') {
+        request.argc -= 1;
+        request.payload = data + line_size;
+        request.payload_size = payload_size;
+    }
+
+    if (!execute(conn, &request)) return -1;
+    return request_size;
+}
+
+/**
+ * API IMPLEMENTATION
+ */
+
+void server57_conn_init(server57_conn_t *conn, server57_pool_t *pool)
+{
+    memset(conn, 0, sizeof(server57_conn_t));
+    conn->pool = pool;
+}
+
+void server57_conn_destroy(server57_conn_t *conn)
+{
+    server57_pool_t *pool = conn->pool;
+
+    for (int i = 0; i < pool->arena.count; i++) {
+        if (pool->owners[i] == conn) {
+            free_session(pool, i);
+        }
+    }
+    free(conn->in);
+    free(conn->out);
+    memset(conn, 0, sizeof(server57_conn_t));
+}
+
+bool server57_conn_receive(server57_conn_t *conn, const unsigned char *data, int size)
+{
+    // Execute the requests from 'data' directly, unless some data is waiting.
+    const unsigned char *start = data;
+    int count = size;
+    if (conn->in_count > 0) {
+        if (conn->in_count + size > conn->in_capacity) {
+            int capacity = conn->in_count + size;
+            unsigned char *in = realloc(conn->in, capacity);
+            if (in == NULL) return false;
+            conn->in = in;
+            conn->in_capacity = capacity;
+        }
+        memcpy(conn->in + conn->in_count, data, size);
+        conn->in_count += size;
+        start = conn->in;
+        count = conn->in_count;
+    }
+
+    int done = 0;
+    for (;;) {
+        int n = execute_next(conn, start + done, count - done);
+        if (n < 0) return false;
+        if (n == 0) break;
+        done += n;
+    }
+
+    // Keep the incomplete request for later.
+    int left = count - done;
+    if (left > 0 && left > conn->in_capacity) {
+        unsigned char *in = realloc(conn->in, left);
+        if (in == NULL) return false;
+        conn->in = in;
+        conn->in_capacity = left;
+    }
+    if (left > 0) {
+        memmove(conn->in, start + done, left);
+    }
+    conn->in_count = left;
+    return true;
+}
+
+void server57_conn_sent(server57_conn_t *conn, int size)
+{
+    memmove(conn->out, conn->out + size, conn->out_count - size);
+    conn->out_count -= size;
+}
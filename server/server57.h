@@ -0,0 +1,90 @@
+/**
+ * The protocol of the session server.
+ *
+ * A client sends requests, each on one line, and gets one response per request, in order. Tokens
+ * are separated by spaces. A line whose last token is "+N" is followed by N bytes of payload.
+ * Requests may be pipelined: all the complete requests received at once are executed, and their
+ * responses are sent together.
+ *
+ * Requests:
+ *   new [OPTIONS]         Creates a session, with RCL57_*_FLAG options. -> ok ID
+ *   free ID               Frees a session.
+ *   load ID +N            Loads the steps and the registers of a .r57 program. -> ok NAME
+ *   press ID KEY          Presses a key, given as row * 10 + col (such as 81 for R/S).
+ *   release ID            Releases the key.
+ *   run ID [MS]           Runs until the calculator waits for a key event, for up to MS ms of
+ *                         emulated time. -> ok CYCLES idle|busy
+ *   display ID            -> ok DISPLAY
+ *   regs ID               -> ok R0 R1 ... R7
+ *   log ID [COUNT]        The last COUNT log entries. -> ok +N, with "INDEX TYPE MESSAGE" lines.
+ *   snapshot ID [log]     Saves the state in the format of save57.h. -> ok +N
+ *   restore ID +N         Restores a state saved with 'snapshot'.
+ * Errors are reported as "err MESSAGE".
+ *
+ * Sessions belong to the connection that created them, and are freed when it closes. They are
+ * allocated from a pool, one per worker thread, and reused once freed.
+ */
+
+#ifndef server57_h
+#define server57_h
+
+#include <stdbool.h>
+
+#include "arena57.h"
+
+/** The maximum length of a request line. */
+#define SERVER57_MAX_LINE 256
+
+/** The size of the end of a line too long that is kept, to read the size of its payload. */
+#define SERVER57_SKIPPED_TAIL 16
+
+/** The maximum size of a payload. */
+#define SERVER57_MAX_PAYLOAD 32768
+
+/** The sessions of a worker thread. */
+typedef struct server57_pool_s {
+    arena57_t arena;
+    void **owners;       // The connection using each instance of the arena, or NULL.
+    int *free_indexes;   // The instances that have been freed, to be reused first.
+    int free_count;
+} server57_pool_t;
+
+typedef struct server57_conn_s {
+    server57_pool_t *pool;
+    unsigned char *in;   // The requests received and not yet executed.
+    int in_count;
+    int in_capacity;
+    unsigned char *out;  // The responses not yet sent.
+    int out_count;
+    int out_capacity;
+    bool is_skipping;    // Whether the rest of a line that is too long is being skipped.
+    char skipped_tail[SERVER57_SKIPPED_TAIL];  // The end of the line being skipped.
+    int skipped_tail_length;
+    bool is_tail_cut;    // Whether the line being skipped is longer than its tail.
+    int payload_skip_count;  // The bytes still to skip from the payload of a skipped line.
+} server57_conn_t;
+
+/** Initializes a pool for up to 'capacity' sessions. Returns false if out of memory. */
+bool server57_pool_init(server57_pool_t *pool, int capacity);
+
+/** Frees a pool and its sessions. */
+void server57_pool_destroy(server57_pool_t *pool);
+
+/** Initializes a connection using the sessions of 'pool'. */
+void server57_conn_init(server57_conn_t *conn, server57_pool_t *pool);
+
+/** Frees the buffers of a connection and its sessions. */
+void server57_conn_destroy(server57_conn_t *conn);
+
+/**
+ * Executes the complete requests in 'data' and in the data received before, and appends the
+ * responses to 'out'.
+ *
+ * Returns false if the connection should be closed, such as when out of memory.
+ */
+bool server57_conn_receive(server57_conn_t *conn, const unsigned char *data, int size);
+
+/** Removes the first 'size' bytes of 'out', once they have been sent. */
+void server57_conn_sent(server57_conn_t *conn, int size);
+
+#endif  /* !server57_h */
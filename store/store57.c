@@ -0,0 +1,285 @@
+#include "store57.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "save57.h"
+
+/**
+ * FILE LAYOUT
+ *
+ * Header page: file_header_t
+ * Slot 0:      buffer 0, buffer 1
+ * Slot 1:      buffer 0, buffer 1
+ * ...
+ *
+ * Each buffer is a buffer_header_t followed by 'data_size' bytes of saved state, and is aligned on
+ * a cache line.
+ */
+
+#define HEADER_SIZE 4096
+#define BUFFER_ALIGNMENT 64
+
+static const char MAGIC[] = {'R', '5', '7', 'D'};
+
+typedef struct file_header_s {
+    char magic[4];
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t data_size;
+} file_header_t;
+
+typedef struct buffer_header_s {
+    uint64_t seq;    // Incremented on each save into the slot, 0 if the buffer is empty.
+    uint32_t size;   // The size of the saved state.
+    uint32_t check;  // Detects a header that doesn't match the data, after a partial write.
+} buffer_header_t;
+
+static size_t get_buffer_size(int data_size)
+{
+    size_t size = sizeof(buffer_header_t) + data_size;
+
+    return (size + BUFFER_ALIGNMENT - 1) / BUFFER_ALIGNMENT * BUFFER_ALIGNMENT;
+}
+
+static size_t get_length(int slot_count, int data_size)
+{
+    return HEADER_SIZE + (size_t)slot_count * 2 * get_buffer_size(data_size);
+}
+
+static buffer_header_t *get_buffer(store57_t *store, int slot, int i)
+{
+    size_t offset = HEADER_SIZE + (2 * (size_t)slot + i) * get_buffer_size(store->data_size);
+
+    return (buffer_header_t *)(store->base + offset);
+}
+
+static unsigned char *get_data(buffer_header_t *buffer)
+{
+    return (unsigned char *)(buffer + 1);
+}
+
+/**
+ * Includes the checksum that ends the saved state, so that the header of a save doesn't validate
+ * the data of an older save of the same size, when only the header reached the disk.
+ */
+static uint32_t get_check(uint64_t seq, uint32_t size, const unsigned char *data)
+{
+    uint32_t crc = 0;
+
+    if (size >= 4) memcpy(&crc, data + size - 4, 4);
+    return ((uint32_t)seq ^ (uint32_t)(seq >> 32)) * 2654435761u ^ size ^ crc ^ 0x52353744;
+}
+
+static bool is_valid(store57_t *store, buffer_header_t *buffer)
+{
+    return buffer->seq != 0 &&
+           buffer->size <= (uint32_t)store->data_size &&
+           buffer->check == get_check(buffer->seq, buffer->size, get_data(buffer)) &&
+           save57_is_valid(get_data(buffer), buffer->size);
+}
+
+/** Records that a range of the file needs to be synced. */
+static void mark_dirty(store57_t *store, void *start, size_t length)
+{
+    size_t offset = (unsigned char *)start - store->base;
+
+    if (store->dirty_end <= store->dirty_start) {
+        store->dirty_start = offset;
+        store->dirty_end = offset + length;
+        return;
+    }
+    if (offset < store->dirty_start) store->dirty_start = offset;
+    if (offset + length > store->dirty_end) store->dirty_end = offset + length;
+}
+
+/**
+ * Returns the state of a slot, validating its buffers the first time.
+ *
+ * The header of an invalid buffer, what remains of a save lost in a crash, is cleared and synced
+ * before the buffer is written again. Otherwise, after another crash, the parts of the next save
+ * that reach the disk could complete the lost one, which would replace the last synced state.
+ */
+static store57_slot_t *get_slot(store57_t *store, int slot)
+{
+    store57_slot_t *s = &store->slots[slot];
+    bool is_cleared = false;
+
+    assert(0 <= slot && slot < store->slot_count);
+    if (s->is_read) return s;
+
+    for (int i = 0; i < 2; i++) {
+        buffer_header_t *buffer = get_buffer(store, slot, i);
+        s->seqs[i] = is_valid(store, buffer) ? buffer->seq : 0;
+        if (s->seqs[i] == 0 && buffer->seq != 0) {
+            buffer->seq = 0;
+            mark_dirty(store, buffer, sizeof(buffer_header_t));
+            is_cleared = true;
+        }
+    }
+    s->pending = -1;
+    s->is_read = true;
+    if (is_cleared) {
+        store57_sync(store);
+    }
+    return s;
+}
+
+/** Returns the buffer to restore a slot from, or -1 if the slot is empty. */
+static int get_latest(store57_slot_t *s)
+{
+    if (s->seqs[0] == 0 && s->seqs[1] == 0) return -1;
+    return s->seqs[0] > s->seqs[1] ? 0 : 1;
+}
+
+/** Returns the length of the mapped file, or 0 if it can't be created or is invalid. */
+static size_t init_file(store57_t *store, int slot_count, int data_size)
+{
+    struct stat st;
+    file_header_t header;
+
+    if (fstat(store->fd, &st) < 0) return 0;
+
+    if (st.st_size == 0) {
+        if (slot_count <= 0 || data_size < SAVE57_MAX_CORE_SIZE) return 0;
+
+        size_t length = get_length(slot_count, data_size);
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = STORE57_VERSION;
+        header.slot_count = slot_count;
+        header.data_size = data_size;
+        if (ftruncate(store->fd, length) < 0) return 0;
+        if (pwrite(store->fd, &header, sizeof(header), 0) != sizeof(header)) return 0;
+        if (fsync(store->fd) < 0) return 0;
+    } else {
+        if (pread(store->fd, &header, sizeof(header), 0) != sizeof(header)) return 0;
+        if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) return 0;
+        if (header.version != STORE57_VERSION) return 0;
+        if (header.slot_count == 0 || header.data_size < SAVE57_MAX_CORE_SIZE) return 0;
+        if ((size_t)st.st_size != get_length(header.slot_count, header.data_size)) return 0;
+    }
+
+    store->slot_count = header.slot_count;
+    store->data_size = header.data_size;
+    return get_length(store->slot_count, store->data_size);
+}
+
+/**
+ * API IMPLEMENTATION
+ */
+
+bool store57_open(store57_t *store, const char *path, int slot_count, int data_size)
+{
+    memset(store, 0, sizeof(store57_t));
+
+    store->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (store->fd < 0) return false;
+
+    store->length = init_file(store, slot_count, data_size);
+    if (store->length == 0) {
+        close(store->fd);
+        return false;
+    }
+
+    void *base = mmap(NULL, store->length, PROT_READ | PROT_WRITE, MAP_SHARED, store->fd, 0);
+    store->slots = calloc(store->slot_count, sizeof(store57_slot_t));
+    if (base == MAP_FAILED || store->slots == NULL) {
+        if (base != MAP_FAILED) munmap(base, store->length);
+        free(store->slots);
+        close(store->fd);
+        return false;
+    }
+    store->base = base;
+    return true;
+}
+
+void store57_close(store57_t *store)
+{
+    store57_sync(store);
+    munmap(store->base, store->length);
+    free(store->slots);
+    close(store->fd);
+    memset(store, 0, sizeof(store57_t));
+}
+
+bool store57_save(store57_t *store, int slot, rcl57_t *rcl57, int flags)
+{
+    store57_slot_t *s = get_slot(store, slot);
+    int i = s->pending;
+
+    // Never overwrite the last synced state: write again into the buffer saved since the last
+    // sync if there is one, or into the buffer that isn't the latest one.
+    if (i < 0) {
+        int latest = get_latest(s);
+        i = latest < 0 ? 0 : 1 - latest;
+    }
+
+    buffer_header_t *buffer = get_buffer(store, slot, i);
+    uint64_t seq = s->seqs[1 - i] + 1;
+
+    int size = save57_write(rcl57, get_data(buffer), store->data_size, flags);
+    if (size == 0) {
+        buffer->seq = 0;
+    } else {
+        buffer->size = size;
+        buffer->check = get_check(seq, size, get_data(buffer));
+        buffer->seq = seq;
+    }
+    s->seqs[i] = size == 0 ? 0 : seq;
+    s->pending = i;
+    mark_dirty(store, buffer, sizeof(buffer_header_t) + size);
+
+    if (store->sync_interval > 0 && ++store->unsynced_count >= store->sync_interval) {
+        store57_sync(store);
+    }
+    return size != 0;
+}
+
+bool store57_load(store57_t *store, int slot, rcl57_t *rcl57)
+{
+    int i = get_latest(get_slot(store, slot));
+
+    if (i < 0) return false;
+
+    buffer_header_t *buffer = get_buffer(store, slot, i);
+    return save57_read(rcl57, get_data(buffer), buffer->size);
+}
+
+void store57_erase(store57_t *store, int slot)
+{
+    store57_slot_t *s = get_slot(store, slot);
+
+    for (int i = 0; i < 2; i++) {
+        buffer_header_t *buffer = get_buffer(store, slot, i);
+        buffer->seq = 0;
+        s->seqs[i] = 0;
+        mark_dirty(store, buffer, sizeof(buffer_header_t));
+    }
+    s->pending = -1;
+}
+
+bool store57_sync(store57_t *store)
+{
+    bool result = true;
+
+    if (store->dirty_end > store->dirty_start) {
+        size_t page_size = sysconf(_SC_PAGESIZE);
+        size_t start = store->dirty_start / page_size * page_size;
+        result = msync(store->base + start, store->dirty_end - start, MS_SYNC) == 0;
+    }
+    if (result) {
+        store->dirty_start = store->dirty_end = 0;
+        store->unsynced_count = 0;
+        for (int slot = 0; slot < store->slot_count; slot++) {
+            store->slots[slot].pending = -1;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,89 @@
+/**
+ * A persistent store of RCL-57 sessions, kept in a memory-mapped file.
+ *
+ * The file starts with a header page, followed by fixed-size slots, one per session. Each slot
+ * has 2 buffers, and a save only writes the older one, in place, in the format of save57.h. The
+ * buffer is committed by writing its sequence number last.
+ *
+ * Saves are only guaranteed to be on disk after 'store57_sync', which flushes all the saves since
+ * the previous sync at once. Until then, the other buffer of a slot still holds the last synced
+ * state, so that a crash at any time loses at most the unsynced saves.
+ *
+ * Opening a store doesn't read the slots, and loading a slot only decodes this slot. The buffers
+ * of a slot are validated the first time it is used, so that later saves don't check them again:
+ * the file should only be modified through a single store57_t at a time. If a save was lost in a
+ * crash, using its slot the first time syncs the store.
+ *
+ * cli/app_store57.c checks the recovery from crashes.
+ *
+ * The file is not portable across platforms of different endianness.
+ */
+
+#ifndef store57_h
+#define store57_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rcl57.h"
+
+/** The current version of the file format. */
+#define STORE57_VERSION 2
+
+/** What is known of the buffers of a slot, read from the file the first time the slot is used. */
+typedef struct store57_slot_s {
+    uint64_t seqs[2];        // The sequence number of each buffer, 0 if the buffer is not valid.
+    signed char pending;     // The buffer saved since the last sync, or -1.
+    bool is_read;            // Whether 'seqs' have been read from the file.
+} store57_slot_t;
+
+typedef struct store57_s {
+    int fd;                  // The file descriptor of the store.
+    unsigned char *base;     // The start of the mapped file.
+    size_t length;           // The length of the file.
+    int slot_count;          // The number of slots.
+    int data_size;           // The maximum size of a saved state.
+    int sync_interval;       // The number of saves between automatic syncs, 0 for no auto sync.
+    int unsynced_count;      // The number of saves since the last sync.
+    store57_slot_t *slots;   // The state of each slot.
+    size_t dirty_start;      // The range of the file modified since the last sync.
+    size_t dirty_end;
+} store57_t;
+
+/**
+ * Opens the store at 'path', creating it with 'slot_count' slots of 'data_size' bytes each if it
+ * doesn't exist. 'data_size' should be at least SAVE57_MAX_CORE_SIZE. Existing stores keep their
+ * own number of slots and size.
+ *
+ * Returns false if the file can't be opened or is not a valid store.
+ */
+bool store57_open(store57_t *store, const char *path, int slot_count, int data_size);
+
+/** Syncs and closes the store. */
+void store57_close(store57_t *store);
+
+/**
+ * Saves 'rcl57' into a given slot, in 0..slot_count-1.
+ *
+ * 'flags' is a combination of SAVE57_*_FLAG flags. Returns false if the state doesn't fit.
+ */
+bool store57_save(store57_t *store, int slot, rcl57_t *rcl57, int flags);
+
+/**
+ * Restores 'rcl57' from a given slot, in 0..slot_count-1.
+ *
+ * Returns false, leaving 'rcl57' untouched, if the slot is empty or can't be restored.
+ */
+bool store57_load(store57_t *store, int slot, rcl57_t *rcl57);
+
+/**
+ * Empties a given slot, in 0..slot_count-1. After a crash before the next sync, the slot may not
+ * be empty.
+ */
+void store57_erase(store57_t *store, int slot);
+
+/** Writes all the saves since the last sync to disk. Returns false on I/O error. */
+bool store57_sync(store57_t *store);
+
+#endif  /* !store57_h */